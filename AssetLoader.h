@@ -0,0 +1,270 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include "Log.h"
+#include "MessageQueue.h"
+#include "Model.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Awaitable asset loading on C++20 coroutines.
+// An asset coroutine moves between threads by awaiting where it wants to continue: co_await
+// loader.onWorker() resumes it on one of the loader's worker threads for parsing and decoding, and
+// co_await loader.onRenderThread() resumes it from the next pump(), which the render loop calls at a
+// point in the frame where GL calls are safe. pump() takes a time budget, so a burst of finished
+// loads is uploaded over several frames instead of in one hitch. Coroutines return a Task<T>, which
+// other coroutines co_await; spawn() starts one from plain code and hands its result to a callback
+// on the render thread:
+//     loader.spawn(loadModel(loader, path), [](std::unique_ptr<Model> model) { ... });
+template <typename T>
+class Task
+{
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        // the coroutine awaiting this one, resumed when it finishes
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        // tasks start when they are awaited
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> finished) noexcept
+            {
+                std::coroutine_handle<> next = finished.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_value(T result)
+        {
+            value = std::move(result);
+        }
+
+        void unhandled_exception()
+        {
+            error = std::current_exception();
+        }
+    };
+
+    Task(Task&& other) noexcept : coroutine(std::exchange(other.coroutine, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (coroutine)
+            coroutine.destroy();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    // starts the task, resuming awaiting when it finishes
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        coroutine.promise().continuation = awaiting;
+        return coroutine;
+    }
+
+    T await_resume()
+    {
+        if (coroutine.promise().error)
+            std::rethrow_exception(coroutine.promise().error);
+        return std::move(*coroutine.promise().value);
+    }
+
+private:
+    std::coroutine_handle<promise_type> coroutine;
+
+    explicit Task(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+};
+
+class AssetLoader
+{
+public:
+    // construct on the render thread; worker threads for the CPU stages, kept few so they leave the
+    // cores to the frame's jobs
+    explicit AssetLoader(unsigned int threads = 2) : workers(threads), renderThread(std::this_thread::get_id()) {}
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    ~AssetLoader()
+    {
+        finish();
+    }
+
+    // render thread only: waits for every load in flight and hands it to its callback
+    void finish()
+    {
+        while (inFlight.load() > 0)
+        {
+            if (pump(1.0e9) == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    // loads started and not yet handed to their callback
+    int pending() const
+    {
+        return inFlight.load();
+    }
+
+    // co_await loader.onWorker(): continue on a worker thread
+    auto onWorker()
+    {
+        struct Awaiter {
+            ThreadPool& pool;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> coroutine) { pool.submit([coroutine]() { coroutine.resume(); }); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ workers };
+    }
+
+    // co_await loader.onRenderThread(): continue from the render thread's next pump(), or right away
+    // when already there
+    auto onRenderThread()
+    {
+        struct Awaiter {
+            MessageQueue<std::coroutine_handle<> >& queue;
+            std::thread::id renderThread;
+            bool await_ready() const noexcept { return std::this_thread::get_id() == renderThread; }
+            void await_suspend(std::coroutine_handle<> coroutine) { queue.post(coroutine); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ renderQueue, renderThread };
+    }
+
+    // render thread only: resumes coroutines waiting for it until budgetMilliseconds have passed,
+    // the rest wait for the next call; returns how many were resumed
+    int pump(double budgetMilliseconds)
+    {
+        renderQueue.drain(arrived);
+        ready.insert(ready.end(), arrived.begin(), arrived.end());
+        if (ready.empty())
+            return 0;
+        TRACE_SCOPE("asset uploads");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int resumed = 0;
+        while (!ready.empty())
+        {
+            std::coroutine_handle<> coroutine = ready.front();
+            ready.pop_front();
+            coroutine.resume();
+            resumed++;
+            if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > budgetMilliseconds)
+                break;
+        }
+        return resumed;
+    }
+
+    // starts task and calls done with its result on the render thread
+    template <typename T>
+    void spawn(Task<T> task, std::function<void(std::type_identity_t<T>)> done)
+    {
+        inFlight.fetch_add(1);
+        run(*this, std::move(task), std::move(done));
+    }
+
+private:
+    ThreadPool workers;
+    const std::thread::id renderThread;
+    MessageQueue<std::coroutine_handle<> > renderQueue;
+    // render thread only
+    std::vector<std::coroutine_handle<> > arrived;
+    std::deque<std::coroutine_handle<> > ready;
+    std::atomic<int> inFlight{ 0 };
+
+    // coroutine that owns a spawned task and frees itself when done
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    template <typename T>
+    static Detached run(AssetLoader& loader, Task<T> task, std::function<void(T)> done)
+    {
+        std::optional<T> result;
+        try
+        {
+            result.emplace(co_await task);
+        }
+        catch (const std::exception& error)
+        {
+            LOG_ERROR("ERROR::ASSET_LOADER::LOAD_FAILED {}", error.what());
+        }
+        catch (...)
+        {
+            LOG_ERROR("ERROR::ASSET_LOADER::LOAD_FAILED unknown exception");
+        }
+        co_await loader.onRenderThread();
+        if (result)
+            done(std::move(*result));
+        loader.inFlight.fetch_sub(1);
+    }
+};
+
+// parses the model and decodes its textures on a worker, then uploads it on the render thread
+inline Task<std::unique_ptr<Model> > loadModel(AssetLoader& loader, std::string path)
+{
+    co_await loader.onWorker();
+    std::unique_ptr<Model> model(new Model(path, false, false));
+    co_await loader.onRenderThread();
+    model->upload();
+    co_return std::move(model);
+}
+
+// decodes the image on a worker and creates the texture on the render thread; returns its name,
+// 0 if the file could not be decoded
+inline Task<unsigned int> loadTexture(AssetLoader& loader, std::string path)
+{
+    co_await loader.onWorker();
+    DecodedImage image = DecodeImage(path.c_str());
+    co_await loader.onRenderThread();
+    co_return image.pixels ? TextureFromImage(image) : 0u;
+}
+#endif
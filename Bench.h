@@ -0,0 +1,430 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(SOLAR_SYSTEM_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "SolarSystem.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Headless benchmark mode.
+//   --bench [--frames N] [--warmup N] [--width W] [--height H] [--asteroids N] [--out file.json]
+//   [--trace trace.json]
+//   --regress [--baseline file] [--update-baseline] [--alpha A] [--threshold PERCENT], see Regression.h
+// Renders N frames offscreen along a scripted camera path with a fixed atime step, so two builds
+// render exactly the same frames, and writes per-frame CPU/GPU times and GL counters, and summary
+// percentiles, as JSON.
+// The context is EGL surfaceless where available (Mesa llvmpipe works without a GPU or display),
+// otherwise a hidden GLFW window. --trace is also accepted without --bench: tracing then runs from the
+// start and the trace is written on exit.
+struct BenchOptions {
+    bool enabled = false;
+    int frames = 600;
+    // frames rendered before measuring, so shader compilation and first uploads are not counted
+    int warmup = 60;
+    int width = 1280;
+    int height = 720;
+    int asteroids = 0;
+    float atimeStep = 0.01f;
+    std::string output = "bench.json";
+    // Chrome trace-event file, empty for no trace
+    std::string trace;
+    // regression mode, see Regression.h
+    bool regress = false;
+    std::string baseline = "bench_baseline.txt";
+    bool updateBaseline = false;
+    // a change counts as a regression when it is significant at alpha and slower by more than threshold percent
+    double alpha = 0.01;
+    double threshold = 5.0;
+};
+
+// returns false on an unknown argument; options.enabled and options.regress tell which mode was asked for
+inline bool parseBenchOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--bench")
+            options.enabled = true;
+        else if (arg == "--frames" && hasValue)
+            options.frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue)
+            options.warmup = std::max(0, atoi(argv[++i]));
+        else if (arg == "--width" && hasValue)
+            options.width = std::max(1, atoi(argv[++i]));
+        else if (arg == "--height" && hasValue)
+            options.height = std::max(1, atoi(argv[++i]));
+        else if (arg == "--asteroids" && hasValue)
+            options.asteroids = std::max(0, atoi(argv[++i]));
+        else if (arg == "--out" && hasValue)
+            options.output = argv[++i];
+        else if (arg == "--trace" && hasValue)
+            options.trace = argv[++i];
+        else if (arg == "--regress")
+            options.regress = true;
+        else if (arg == "--baseline" && hasValue)
+            options.baseline = argv[++i];
+        else if (arg == "--update-baseline")
+            options.updateBaseline = true;
+        else if (arg == "--alpha" && hasValue)
+            options.alpha = atof(argv[++i]);
+        else if (arg == "--threshold" && hasValue)
+            options.threshold = atof(argv[++i]);
+        else
+        {
+            LOG_ERROR("ERROR::BENCH::UNKNOWN_ARGUMENT {}", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+// a GL 4.3 core context without a visible window
+class HeadlessContext
+{
+public:
+    bool create()
+    {
+#if defined(SOLAR_SYSTEM_EGL)
+        if (createEGL())
+            return true;
+        LOG_WARN("BENCH::EGL unavailable, falling back to a hidden GLFW window");
+#endif
+        return createGLFW();
+    }
+
+    void destroy()
+    {
+#if defined(SOLAR_SYSTEM_EGL)
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+        if (window != NULL)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            window = NULL;
+        }
+    }
+
+private:
+    GLFWwindow* window = NULL;
+
+#if defined(SOLAR_SYSTEM_EGL)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool createEGL()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay == NULL)
+            return false;
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        // surfaceless contexts need no config (EGL_KHR_no_config_context)
+        context = eglCreateContext(display, (EGLConfig)0, EGL_NO_CONTEXT, attributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+    }
+#endif
+
+    bool createGLFW()
+    {
+        if (!glfwInit())
+            return false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "Solar System bench", NULL, NULL);
+        if (window == NULL)
+        {
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+    }
+};
+
+// camera path over t in [0, 1): one orbit around the sun, bobbing above and below the ecliptic
+// and moving in and out so the view passes over the inner planets and out past the belt
+inline glm::mat4 benchView(float t)
+{
+    const float angle = t * 2.0f * 3.14159265f;
+    float distance = 3.0f + 1.0f * std::sin(angle * 2.0f);
+    glm::vec3 eye(distance * std::sin(angle), 0.8f * std::sin(angle * 3.0f), distance * std::cos(angle));
+    return glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+struct BenchSummary {
+    double mean, min, p50, p90, p95, p99, max;
+};
+
+// nearest-rank percentiles
+inline BenchSummary summarize(std::vector<double> values)
+{
+    BenchSummary summary = {};
+    if (values.empty())
+        return summary;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (unsigned int i = 0; i < values.size(); i++)
+        sum += values[i];
+    const unsigned int n = (unsigned int)values.size();
+    summary.mean = sum / n;
+    summary.min = values.front();
+    summary.max = values.back();
+    summary.p50 = values[std::min(n - 1, (unsigned int)std::ceil(0.50 * n) - 1)];
+    summary.p90 = values[std::min(n - 1, (unsigned int)std::ceil(0.90 * n) - 1)];
+    summary.p95 = values[std::min(n - 1, (unsigned int)std::ceil(0.95 * n) - 1)];
+    summary.p99 = values[std::min(n - 1, (unsigned int)std::ceil(0.99 * n) - 1)];
+    return summary;
+}
+
+inline void writeSummary(std::ofstream& out, const char* name, const BenchSummary& summary)
+{
+    out << "  \"" << name << "\": { \"mean\": " << summary.mean << ", \"min\": " << summary.min
+        << ", \"p50\": " << summary.p50 << ", \"p90\": " << summary.p90 << ", \"p95\": " << summary.p95
+        << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " },\n";
+}
+
+inline void writeCounters(std::ofstream& out, const GLFrameCounters& counters)
+{
+    out << "\"draws\": " << counters.draws << ", \"indirect_draws\": " << counters.indirectDraws
+        << ", \"dispatches\": " << counters.dispatches << ", \"triangles\": " << counters.triangles
+        << ", \"program_binds\": " << counters.programBinds << ", \"vao_binds\": " << counters.vaoBinds
+        << ", \"texture_binds\": " << counters.textureBinds << ", \"buffer_binds\": " << counters.bufferBinds
+        << ", \"uniform_calls\": " << counters.uniformCalls << ", \"uploads\": " << counters.uploads
+        << ", \"upload_bytes\": " << counters.uploadBytes;
+}
+
+// per-frame average, rounded down
+inline GLFrameCounters meanCounters(const std::vector<GLFrameCounters>& frames)
+{
+    GLFrameCounters mean = GLFrameCounters();
+    if (frames.empty())
+        return mean;
+    unsigned long long sums[9] = {};
+    for (unsigned int i = 0; i < frames.size(); i++)
+    {
+        const GLFrameCounters& frame = frames[i];
+        sums[0] += frame.draws;
+        sums[1] += frame.indirectDraws;
+        sums[2] += frame.dispatches;
+        sums[3] += frame.programBinds;
+        sums[4] += frame.vaoBinds;
+        sums[5] += frame.textureBinds;
+        sums[6] += frame.bufferBinds;
+        sums[7] += frame.uniformCalls;
+        sums[8] += frame.uploads;
+        mean.triangles += frame.triangles;
+        mean.uploadBytes += frame.uploadBytes;
+    }
+    const unsigned long long n = frames.size();
+    mean.draws = (unsigned int)(sums[0] / n);
+    mean.indirectDraws = (unsigned int)(sums[1] / n);
+    mean.dispatches = (unsigned int)(sums[2] / n);
+    mean.programBinds = (unsigned int)(sums[3] / n);
+    mean.vaoBinds = (unsigned int)(sums[4] / n);
+    mean.textureBinds = (unsigned int)(sums[5] / n);
+    mean.bufferBinds = (unsigned int)(sums[6] / n);
+    mean.uniformCalls = (unsigned int)(sums[7] / n);
+    mean.uploads = (unsigned int)(sums[8] / n);
+    mean.triangles /= n;
+    mean.uploadBytes /= n;
+    return mean;
+}
+
+// surfaceless contexts have no default framebuffer, so the frames are resolved into our own
+struct BenchTarget {
+    unsigned int FBO = 0;
+    unsigned int colorBuffer = 0;
+
+    void create(int width, int height)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        GpuMemory::track(GpuMemory::RENDERBUFFER, colorBuffer, GpuMemory::textureBytes(width, height, 1, 4, false), "bench", "output color");
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        GpuMemory::deleteRenderbuffers(1, &colorBuffer);
+        FBO = colorBuffer = 0;
+    }
+};
+
+// renders options.warmup + options.frames frames along the camera path into system.oit.outputFBO and
+// waits for them; the measured frames' timings are appended to profiler.frameLog and their GL
+// counters to counters
+inline void renderBenchFrames(SolarSystem& system, Profiler& profiler, const BenchOptions& options, std::vector<GLFrameCounters>& counters)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)options.width / (float)options.height, 0.1f, 100.0f);
+    const int total = options.warmup + options.frames;
+    for (int frame = 0; frame < total; frame++)
+    {
+        TRACE_SCOPE("frame");
+        GLStats::beginFrame();
+        // the profiler reports frames two behind, so logging starts as the first measured one comes out
+        profiler.logFrames = frame >= options.warmup + 2;
+        profiler.beginFrame();
+        float atime = frame * options.atimeStep;
+        {
+            ProfileScope zone(&profiler, "scene traversal");
+            system.scene.update(atime, 0.25f, 0.0f, 0.0f, 0.5f);
+        }
+        system.render(benchView((float)frame / total), projection, options.width, options.height, 50);
+        profiler.endFrame();
+        system.arena.reset();
+        if (frame >= options.warmup)
+            counters.push_back(GLStats::frame());
+    }
+    profiler.logFrames = true;
+    profiler.flush();
+    glFinish();
+    profiler.logFrames = false;
+}
+
+inline int runBench(const BenchOptions& options)
+{
+    HeadlessContext headless;
+    if (!headless.create())
+    {
+        LOG_ERROR("ERROR::BENCH::CONTEXT_CREATION_FAILED");
+        return -1;
+    }
+    std::string rendererName = (const char*)glGetString(GL_RENDERER);
+    std::string versionName = (const char*)glGetString(GL_VERSION);
+    LOG_INFO("BENCH::CONTEXT {}, {}", rendererName, versionName);
+    GLStats::install();
+    Trace::setThreadName("main");
+    Trace::setEnabled(!options.trace.empty());
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    {
+        BenchTarget target;
+        target.create(options.width, options.height);
+
+        Profiler profiler;
+        profiler.blocking = true;
+        SolarSystem system(&profiler, 50);
+        system.oit.outputFBO = target.FBO;
+        if (options.asteroids > 0)
+            system.scene.generateAsteroids(options.asteroids);
+
+        std::vector<GLFrameCounters> counters;
+        renderBenchFrames(system, profiler, options, counters);
+
+        std::vector<double> cpu, gpu;
+        for (unsigned int i = 0; i < profiler.frameLog.size(); i++)
+        {
+            cpu.push_back(profiler.frameLog[i].cpuTime);
+            gpu.push_back(profiler.frameLog[i].gpuTime);
+        }
+        BenchSummary cpuSummary = summarize(cpu);
+        BenchSummary gpuSummary = summarize(gpu);
+
+        std::ofstream out(options.output.c_str());
+        if (!out)
+        {
+            LOG_ERROR("ERROR::BENCH::FILE_NOT_SUCCESFULLY_WRITTEN {}", options.output);
+        }
+        else
+        {
+            out << "{\n";
+            out << "  \"renderer\": \"" << rendererName << "\",\n";
+            out << "  \"version\": \"" << versionName << "\",\n";
+            out << "  \"frames\": " << options.frames << ",\n";
+            out << "  \"warmup\": " << options.warmup << ",\n";
+            out << "  \"width\": " << options.width << ",\n";
+            out << "  \"height\": " << options.height << ",\n";
+            out << "  \"asteroids\": " << options.asteroids << ",\n";
+            out << "  \"bodies\": " << system.scene.bodies.size() << ",\n";
+            out << "  \"atime_step\": " << options.atimeStep << ",\n";
+            out << "  \"gpu_memory_bytes\": " << GpuMemory::totalBytes() << ",\n";
+            out << "  \"gpu_memory_peak_bytes\": " << GpuMemory::peakBytes() << ",\n";
+            writeSummary(out, "cpu_ms", cpuSummary);
+            writeSummary(out, "gpu_ms", gpuSummary);
+            out << "  \"gl_counters_mean\": { ";
+            writeCounters(out, meanCounters(counters));
+            out << " },\n";
+            out << "  \"per_frame\": [\n";
+            for (unsigned int i = 0; i < cpu.size(); i++)
+            {
+                out << "    { \"cpu_ms\": " << cpu[i] << ", \"gpu_ms\": " << gpu[i] << ", ";
+                writeCounters(out, i < counters.size() ? counters[i] : GLFrameCounters());
+                out << " }";
+                out << (i + 1 < cpu.size() ? ",\n" : "\n");
+            }
+            out << "  ]\n";
+            out << "}\n";
+        }
+        LOG_INFO("BENCH::RESULT {} frames, CPU p50 {} ms p99 {} ms, GPU p50 {} ms p99 {} ms -> {}", cpu.size(), cpuSummary.p50,
+                 cpuSummary.p99, gpuSummary.p50, gpuSummary.p99, options.output);
+
+        GpuMemory::dump();
+        if (!options.trace.empty())
+            Trace::write(options.trace);
+
+        target.destroy();
+    }
+    headless.destroy();
+    return 0;
+}
+#endif
@@ -0,0 +1,487 @@
+#ifndef BODY_RENDERER_H
+#define BODY_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "FrameArena.h"
+#include "GpuMemory.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "Model.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "ShaderHotReload.h"
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+// per-instance data streamed to shader.vert, one per drawn body
+struct BodyInstance {
+    glm::mat4 model;
+    glm::vec4 color;
+    // texture array layer, negative when untextured
+    float layer;
+    float padding[3];
+};
+
+// per-body input of the GPU culling pass, see cull.comp
+struct BodyCullInput {
+    BodyInstance instance;
+    glm::vec4 bounds;
+    unsigned int batch;
+    unsigned int padding[3];
+};
+
+// layout of the commands read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// Draws bodies with one instanced call per mesh and pass.
+// All body meshes share a single vertex/index buffer behind one VAO, and each frame the visible bodies
+// are bucketed by pass and mesh into one instance buffer. Together with the body texture array this
+// lets bodies with different textures and colors share a draw call.
+// With GPU culling (GL 4.3) the bodies are uploaded unculled instead: a compute pass frustum-culls
+// them, appends the survivors to each batch's instance range and counts them into indirect draw
+// commands, so each pass is a single multi-draw and the CPU never looks at the culling results.
+// The per-frame instance data, cull inputs and commands live in StreamBuffer rings with a region per
+// frame in flight, so writing the next frame never waits for the GPU to finish reading this one.
+class BodyRenderer
+{
+public:
+    unsigned int drawCalls = 0;
+    bool gpuCulling = false;
+    // compute shaders, SSBOs and indirect draws are all GL 4.3
+    bool gpuCullingSupported = false;
+    // glMultiDrawElementsIndirectCount (GL 4.6 or ARB_indirect_parameters) lets the GPU trim each pass
+    // to its last non-empty batch, otherwise every batch's command is issued
+    bool indirectCountSupported = false;
+    // optional, times each mesh's draw
+    Profiler* profiler = NULL;
+    // optional, buckets the bodies in parallel
+    JobSystem* jobs = NULL;
+
+    // constructor, merges the models' meshes into the shared buffers; a NULL model reserves a
+    // dynamic region of dynamicVertices vertices that is filled with updateMesh()
+    BodyRenderer(Model* models[MESH_COUNT], unsigned int dynamicVertices) : instanceStream(GL_ARRAY_BUFFER, "BodyRenderer", "instances")
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        for (int mesh = 0; mesh < MESH_COUNT; mesh++)
+        {
+            MeshRange& range = ranges[mesh];
+            range.firstIndex = (unsigned int)indices.size();
+            range.baseVertex = (int)vertices.size();
+            if (models[mesh] != NULL)
+            {
+                for (unsigned int i = 0; i < models[mesh]->meshes.size(); i++)
+                {
+                    const Mesh& source = models[mesh]->meshes[i];
+                    unsigned int offset = (unsigned int)vertices.size() - range.baseVertex;
+                    vertices.insert(vertices.end(), source.vertices.begin(), source.vertices.end());
+                    for (unsigned int j = 0; j < source.indices.size(); j++)
+                        indices.push_back(source.indices[j] + offset);
+                }
+                range.capacity = (unsigned int)vertices.size() - range.baseVertex;
+                range.indexCount = (unsigned int)indices.size() - range.firstIndex;
+            }
+            else
+            {
+                // dynamic meshes are non-indexed triangle lists, so the index buffer is just a sequence
+                Vertex empty = {};
+                vertices.insert(vertices.end(), dynamicVertices, empty);
+                for (unsigned int j = 0; j < dynamicVertices; j++)
+                    indices.push_back(j);
+                range.capacity = dynamicVertices;
+                range.indexCount = 0;
+            }
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        GpuMemory::track(GpuMemory::BUFFER, VBO, vertices.size() * sizeof(Vertex), "BodyRenderer", "body vertices");
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        GpuMemory::track(GpuMemory::BUFFER, EBO, indices.size() * sizeof(unsigned int), "BodyRenderer", "body indices");
+
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+        // per-instance model matrix (one attribute per column), color and texture layer
+        glBindBuffer(GL_ARRAY_BUFFER, instanceStream.id());
+        for (unsigned int attribute = 3; attribute <= 8; attribute++)
+        {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        setInstanceOffset(instanceStream.id(), 0);
+        glBindVertexArray(0);
+
+        gpuCullingSupported = GLAD_GL_VERSION_4_3 != 0;
+#if defined(GL_VERSION_4_6)
+        if (GLAD_GL_VERSION_4_6)
+            multiDrawIndirectCount = glMultiDrawElementsIndirectCount;
+#endif
+#if defined(GL_ARB_indirect_parameters)
+        if (multiDrawIndirectCount == NULL && GLAD_GL_ARB_indirect_parameters)
+            multiDrawIndirectCount = glMultiDrawElementsIndirectCountARB;
+#endif
+        indirectCountSupported = multiDrawIndirectCount != NULL;
+        if (gpuCullingSupported)
+        {
+            cullShader.reset(new Shader("cull.comp"));
+            setupCull(*cullShader);
+            glUseProgram(0);
+            // per-frame inputs of the pass go through frame rings bound by range
+            GLint alignment = 256;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            cullInputStream.reset(new StreamBuffer(GL_SHADER_STORAGE_BUFFER, "BodyRenderer", "cull input", 3, alignment));
+            commandStream.reset(new StreamBuffer(GL_SHADER_STORAGE_BUFFER, "BodyRenderer", "indirect commands", 3, alignment));
+            drawCountStream.reset(new StreamBuffer(GL_SHADER_STORAGE_BUFFER, "BodyRenderer", "draw counts", 3, alignment));
+            glGenBuffers(1, &culledInstanceBuffer);
+        }
+    }
+
+    BodyRenderer(const BodyRenderer&) = delete;
+    BodyRenderer& operator=(const BodyRenderer&) = delete;
+
+    ~BodyRenderer()
+    {
+        const unsigned int buffers[3] = { VBO, EBO, culledInstanceBuffer };
+        GpuMemory::deleteBuffers(3, buffers);
+        glDeleteVertexArrays(1, &VAO);
+    }
+
+    // true when prepare() and draw() go through the compute culling pass
+    bool usingGpuCulling() const
+    {
+        return gpuCulling && gpuCullingSupported;
+    }
+
+    // replaces the vertices of a dynamic mesh, positions only
+    void updateMesh(BodyMesh mesh, const ArenaVector<glm::vec3>& positions, FrameArena& arena)
+    {
+        MeshRange& range = ranges[mesh];
+        unsigned int count = std::min((unsigned int)positions.size(), range.capacity);
+        if (count < positions.size())
+            LOG_EVERY(1.0, WARN, "BODY_RENDERER::MESH_TRUNCATED {} of {} vertices fit", count, positions.size());
+        range.indexCount = count;
+        if (count == 0)
+            return;
+        ArenaVector<Vertex> vertices(count, Vertex(), ArenaAllocator<Vertex>(arena));
+        for (unsigned int i = 0; i < count; i++)
+            vertices[i].Position = positions[i];
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * sizeof(Vertex), count * sizeof(Vertex), &vertices[0]);
+    }
+
+    // buckets the visible bodies by pass and mesh and uploads their instance data; the per-job
+    // bookkeeping comes from arena
+    void prepare(const std::vector<Body>& bodies, FrameArena& arena)
+    {
+        // each job range counts its bodies per batch, then writes them from its own offset in each
+        // batch, so the order within a batch stays the order of the bodies
+        const unsigned int count = (unsigned int)bodies.size();
+        const std::array<unsigned int, BATCH_COUNT> zero = {};
+        RangeCounts rangeNext((count + PREPARE_GRAIN - 1) / PREPARE_GRAIN, zero, ArenaAllocator<std::array<unsigned int, BATCH_COUNT> >(arena));
+        parallelFor(jobs, count, PREPARE_GRAIN, [&](unsigned int begin, unsigned int end) {
+            std::array<unsigned int, BATCH_COUNT>& counts = rangeNext[begin / PREPARE_GRAIN];
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (bodies[i].visible)
+                    counts[batchOf(bodies[i])]++;
+            }
+        });
+
+        unsigned int total = 0;
+        for (int batch = 0; batch < BATCH_COUNT; batch++)
+        {
+            batchFirst[batch] = total;
+            for (unsigned int range = 0; range < rangeNext.size(); range++)
+            {
+                unsigned int counted = rangeNext[range][batch];
+                rangeNext[range][batch] = total;
+                total += counted;
+            }
+            batchCount[batch] = total - batchFirst[batch];
+        }
+
+        drawCalls = 0;
+        if (usingGpuCulling())
+        {
+            prepareGpu(bodies, total, rangeNext);
+            return;
+        }
+
+        // written straight into this frame's region of the ring
+        BodyInstance* instances = (BodyInstance*)instanceStream.begin(total * sizeof(BodyInstance));
+        parallelFor(jobs, count, PREPARE_GRAIN, [&](unsigned int begin, unsigned int end) {
+            std::array<unsigned int, BATCH_COUNT>& next = rangeNext[begin / PREPARE_GRAIN];
+            for (unsigned int i = begin; i < end; i++)
+            {
+                const Body& body = bodies[i];
+                if (body.visible)
+                    writeInstance(instances[next[batchOf(body)]++], body);
+            }
+        });
+
+        instanceStream.end(total * sizeof(BodyInstance));
+    }
+
+    // GPU culling only: frustum-culls the prepared bodies and fills the indirect commands
+    void cull(const glm::mat4& viewProjection)
+    {
+        if (!usingGpuCulling() || cullCount == 0)
+            return;
+        ProfileScope zone(profiler, "gpu culling");
+
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+        cullShader->use();
+        static const char* planeNames[6] = { "frustumPlanes[0]", "frustumPlanes[1]", "frustumPlanes[2]", "frustumPlanes[3]", "frustumPlanes[4]", "frustumPlanes[5]" };
+        for (int p = 0; p < 6; p++)
+            cullShader->setVec4(planeNames[p], planes[p]);
+        cullShader->setUint("bodyCount", cullCount);
+
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, cullInputStream->id(), cullInputStream->offset(), cullCount * sizeof(BodyCullInput));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culledInstanceBuffer);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, commandStream->id(), commandStream->offset(), BATCH_COUNT * sizeof(DrawElementsIndirectCommand));
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, drawCountStream->id(), drawCountStream->offset(), 2 * sizeof(unsigned int));
+        glDispatchCompute((cullCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        // the draws read the commands and the compacted instances the pass just wrote
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        glUseProgram(0);
+    }
+
+    // call once the frame's draws are issued: the frame rings move on to their next region
+    void endFrame()
+    {
+        instanceStream.fence();
+        if (gpuCullingSupported)
+        {
+            cullInputStream->fence();
+            commandStream->fence();
+            drawCountStream->fence();
+        }
+    }
+
+    // reloads the culling shader when its file changes
+    void watchShaders(ShaderHotReload& reload)
+    {
+        if (cullShader)
+            reload.watch(*cullShader, setupCull);
+    }
+
+    // waits of the frame rings for the GPU to release a region, since start
+    unsigned long long streamStalls() const
+    {
+        unsigned long long stalls = instanceStream.stalls;
+        if (gpuCullingSupported)
+            stalls += cullInputStream->stalls + commandStream->stalls + drawCountStream->stalls;
+        return stalls;
+    }
+
+    // draws the opaque or the translucent bodies of the last prepare(), one instanced call per mesh
+    void draw(bool translucent)
+    {
+        glBindVertexArray(VAO);
+        if (usingGpuCulling())
+        {
+            drawIndirect(translucent);
+            glBindVertexArray(0);
+            return;
+        }
+        for (int mesh = 0; mesh < MESH_COUNT; mesh++)
+        {
+            int batch = (translucent ? MESH_COUNT : 0) + mesh;
+            if (batchCount[batch] == 0 || ranges[mesh].indexCount == 0)
+                continue;
+            ProfileScope zone(profiler, meshName(mesh));
+            setInstanceOffset(instanceStream.id(), instanceStream.offset() + batchFirst[batch] * sizeof(BodyInstance));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, ranges[mesh].indexCount, GL_UNSIGNED_INT,
+                (void*)(ranges[mesh].firstIndex * sizeof(unsigned int)), batchCount[batch], ranges[mesh].baseVertex);
+            drawCalls++;
+        }
+        glBindVertexArray(0);
+    }
+
+private:
+    struct MeshRange {
+        unsigned int firstIndex;
+        unsigned int indexCount;
+        int baseVertex;
+        unsigned int capacity;
+    };
+
+    // one batch per mesh for the opaque pass followed by one per mesh for the translucent pass
+    static const int BATCH_COUNT = 2 * MESH_COUNT;
+    // must match local_size_x in cull.comp
+    static const unsigned int CULL_GROUP_SIZE = 64;
+    // GL_PARAMETER_BUFFER, same value as GL_PARAMETER_BUFFER_ARB
+    static const GLenum PARAMETER_BUFFER = 0x80EE;
+
+    // the 4.6 core and the ARB entry point share a signature
+    typedef void (APIENTRYP MultiDrawIndirectCountProc)(GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride);
+    MultiDrawIndirectCountProc multiDrawIndirectCount = NULL;
+
+    unsigned int VAO, VBO, EBO;
+    MeshRange ranges[MESH_COUNT];
+    unsigned int batchFirst[BATCH_COUNT] = {};
+    unsigned int batchCount[BATCH_COUNT] = {};
+    StreamBuffer instanceStream;
+    // bodies bucketed per job, and each job range's next slot in every batch
+    static const unsigned int PREPARE_GRAIN = 2048;
+    typedef ArenaVector<std::array<unsigned int, BATCH_COUNT> > RangeCounts;
+
+    std::unique_ptr<Shader> cullShader;
+    std::unique_ptr<StreamBuffer> cullInputStream, commandStream, drawCountStream;
+    unsigned int culledInstanceBuffer = 0;
+    // instances culledInstanceBuffer has room for, it only grows
+    unsigned int culledCapacity = 0;
+    unsigned int cullCount = 0;
+
+    // uniforms that never change, after building the shader and after every reload
+    static void setupCull(Shader& shader)
+    {
+        shader.use();
+        shader.setUint("meshCount", MESH_COUNT);
+    }
+
+    // profiler zone names
+    static const char* meshName(int mesh)
+    {
+        static const char* names[MESH_COUNT] = { "planets", "sattelites", "orbits", "cones" };
+        return names[mesh];
+    }
+
+    static int batchOf(const Body& body)
+    {
+        return (body.translucent ? MESH_COUNT : 0) + body.mesh;
+    }
+
+    static void writeInstance(BodyInstance& instance, const Body& body)
+    {
+        instance.model = body.model;
+        instance.color = body.color;
+        instance.layer = (float)body.texture;
+    }
+
+    // uploads the bucketed bodies with their bounds, and one command per batch whose instance range
+    // is sized for every body in it; cull() fills in the instance counts
+    void prepareGpu(const std::vector<Body>& bodies, unsigned int total, RangeCounts& rangeNext)
+    {
+        BodyCullInput* cullInputs = (BodyCullInput*)cullInputStream->begin(total * sizeof(BodyCullInput));
+        parallelFor(jobs, (unsigned int)bodies.size(), PREPARE_GRAIN, [&](unsigned int begin, unsigned int end) {
+            std::array<unsigned int, BATCH_COUNT>& next = rangeNext[begin / PREPARE_GRAIN];
+            for (unsigned int i = begin; i < end; i++)
+            {
+                const Body& body = bodies[i];
+                if (!body.visible)
+                    continue;
+                int batch = batchOf(body);
+                BodyCullInput& input = cullInputs[next[batch]++];
+                writeInstance(input.instance, body);
+                input.bounds = body.bounds;
+                input.batch = (unsigned int)batch;
+            }
+        });
+        cullCount = total;
+
+        cullInputStream->end(total * sizeof(BodyCullInput));
+
+        DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)commandStream->begin(BATCH_COUNT * sizeof(DrawElementsIndirectCommand));
+        for (int batch = 0; batch < BATCH_COUNT; batch++)
+        {
+            const MeshRange& range = ranges[batch % MESH_COUNT];
+            commands[batch].count = range.indexCount;
+            commands[batch].instanceCount = 0;
+            commands[batch].firstIndex = range.firstIndex;
+            commands[batch].baseVertex = range.baseVertex;
+            commands[batch].baseInstance = batchFirst[batch];
+        }
+        commandStream->end(BATCH_COUNT * sizeof(DrawElementsIndirectCommand));
+        unsigned int* drawCounts = (unsigned int*)drawCountStream->begin(2 * sizeof(unsigned int));
+        drawCounts[0] = drawCounts[1] = 0;
+        drawCountStream->end(2 * sizeof(unsigned int));
+
+        // the compacted output is only written by the GPU, so it is reallocated only to grow
+        if (std::max(total, 1u) > culledCapacity)
+        {
+            culledCapacity = std::max(std::max(total, 1u), culledCapacity * 2);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, culledInstanceBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, culledCapacity * sizeof(BodyInstance), NULL, GL_DYNAMIC_COPY);
+            GpuMemory::track(GpuMemory::BUFFER, culledInstanceBuffer, culledCapacity * sizeof(BodyInstance), "BodyRenderer", "culled instances");
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+    }
+
+    // one multi-draw per pass over that pass's batch commands
+    void drawIndirect(bool translucent)
+    {
+        unsigned int pass = translucent ? 1 : 0;
+        const void* commands = (void*)(commandStream->offset() + pass * MESH_COUNT * sizeof(DrawElementsIndirectCommand));
+        setInstanceOffset(culledInstanceBuffer, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream->id());
+        if (indirectCountSupported)
+        {
+            glBindBuffer(PARAMETER_BUFFER, drawCountStream->id());
+            multiDrawIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, commands, drawCountStream->offset() + pass * sizeof(unsigned int), MESH_COUNT, 0);
+            glBindBuffer(PARAMETER_BUFFER, 0);
+        }
+        else
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commands, MESH_COUNT, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        drawCalls++;
+    }
+
+    // world-space frustum planes (Gribb & Hartmann), normalized so distances compare against radii
+    static void frustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (int p = 0; p < 6; p++)
+            planes[p] /= glm::length(glm::vec3(planes[p]));
+    }
+
+    // points the instance attributes at the given byte offset of a buffer; the CPU path keeps GL 3.3's
+    // lack of base instance by re-specifying the offsets per batch, the indirect draws pass
+    // baseInstance instead
+    void setInstanceOffset(unsigned int buffer, size_t base)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (unsigned int column = 0; column < 4; column++)
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(BodyInstance), (void*)(base + offsetof(BodyInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(BodyInstance), (void*)(base + offsetof(BodyInstance, color)));
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(BodyInstance), (void*)(base + offsetof(BodyInstance, layer)));
+    }
+};
+#endif
@@ -0,0 +1,36 @@
+#ifndef CONE_H
+#define CONE_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+// Builds the cone used for moons and stars as a non-indexed triangle list: a fan of sides from the
+// apex at (0, 0, height) down to the unit circle, and a fan closing the base, one triangle per
+// "details" degrees. Vector is any std::vector of glm::vec3, e.g. an ArenaVector for a cone that is
+// only needed until it is uploaded.
+template <typename Vector>
+inline void createCone(Vector& vertices, int details, float height)
+{
+    const double toRadians = 3.14159265 / 180.0;
+    vertices.clear();
+    vertices.reserve(6 * (360 / details + 1));
+
+    //sides
+    for (int k = 0; k <= 360; k += details)
+    {
+        vertices.push_back(glm::vec3(0.0f, 0.0f, height));
+        vertices.push_back(glm::vec3(std::cos(toRadians * k), std::sin(toRadians * k), 0.0));
+        vertices.push_back(glm::vec3(std::cos(toRadians * (k + details)), std::sin(toRadians * (k + details)), 0.0));
+    }
+
+    //base
+    for (int k = 0; k <= 360; k += details)
+    {
+        vertices.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
+        vertices.push_back(glm::vec3(std::cos(toRadians * k), std::sin(toRadians * k), 0.0));
+        vertices.push_back(glm::vec3(std::cos(toRadians * (k + details)), std::sin(toRadians * (k + details)), 0.0));
+    }
+}
+#endif
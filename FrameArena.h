@@ -0,0 +1,210 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include "Log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <new>
+#include <vector>
+
+// Linear allocator for data that only lives until the end of the frame.
+// Allocating bumps an offset into a block; nothing is freed on its own, reset() at the end of the frame
+// releases everything at once. When a frame needs more than the block holds, further blocks are
+// chained on, and the next reset() replaces them all with a single block big enough for that frame,
+// so after the first few frames the arena stops touching the heap. Owned and used by one thread;
+// jobs may fill memory allocated from it but not allocate themselves.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockBytes = 1 << 20) : blockBytes(blockBytes) {}
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    ~FrameArena()
+    {
+        for (unsigned int i = 0; i < blocks.size(); i++)
+            ::operator delete(blocks[i].memory);
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        if (blocks.empty() || alignedOffset(blocks.back(), alignment) + bytes > blocks.back().size)
+        {
+            Block block;
+            block.size = std::max(blockBytes, bytes + alignment);
+            block.memory = (char*)::operator new(block.size);
+            block.used = 0;
+            blocks.push_back(block);
+        }
+        Block& block = blocks.back();
+        size_t offset = alignedOffset(block, alignment);
+        block.used = offset + bytes;
+        used += bytes;
+        return block.memory + offset;
+    }
+
+    template <typename T>
+    T* allocate(size_t count)
+    {
+        return (T*)allocate(count * sizeof(T), alignof(T));
+    }
+
+    // frees everything allocated since the last reset
+    void reset()
+    {
+        peak = std::max(peak, used);
+        used = 0;
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (unsigned int i = 0; i < blocks.size(); i++)
+            {
+                total += blocks[i].size;
+                ::operator delete(blocks[i].memory);
+            }
+            blocks.clear();
+            blockBytes = std::max(blockBytes, total);
+        }
+        if (!blocks.empty())
+            blocks[0].used = 0;
+    }
+
+    // bytes allocated since the last reset
+    size_t usedBytes() const
+    {
+        return used;
+    }
+
+    // most bytes any frame has used so far
+    size_t peakBytes() const
+    {
+        return std::max(peak, used);
+    }
+
+private:
+    struct Block {
+        char* memory;
+        size_t size;
+        size_t used;
+    };
+
+    size_t blockBytes;
+    std::vector<Block> blocks;
+    size_t used = 0;
+    size_t peak = 0;
+
+    // offset of the block's first free byte aligned to alignment, a power of two
+    static size_t alignedOffset(const Block& block, size_t alignment)
+    {
+        uintptr_t start = (uintptr_t)block.memory;
+        return (((start + block.used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start);
+    }
+};
+
+// standard allocator over a FrameArena; deallocate does nothing, the memory goes with the next reset()
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    FrameArena* arena;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count)
+    {
+        return arena->allocate<T>(count);
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+};
+
+// vector for transient data, valid until the arena's next reset()
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// Heap allocations per thread, counted by the replacement global operator new in main.cpp in debug
+// builds; without it the count stays 0.
+namespace HeapCheck
+{
+    inline unsigned long long& counter()
+    {
+        thread_local unsigned long long count = 0;
+        return count;
+    }
+
+    // heap allocations made by the calling thread so far
+    inline unsigned long long allocations()
+    {
+        return counter();
+    }
+
+    inline void noteAllocation()
+    {
+        counter()++;
+    }
+}
+
+// Debug check that the steady-state part of a frame never touches the heap: brackets the frame path
+// with begin() and end() and asserts when it allocated on the calling thread although nothing the
+// frame sizes its buffers by changed since the previous frame. The first frames are exempt, they are
+// where containers reach their working size. Does nothing in release builds.
+class FrameHeapCheck
+{
+public:
+    static const int WARMUP_FRAMES = 120;
+    static const int SHAPE_VALUES = 8;
+
+    void begin()
+    {
+        start = HeapCheck::allocations();
+    }
+
+    // shape: up to SHAPE_VALUES values such as element counts and target sizes
+    void end(std::initializer_list<unsigned long long> shape)
+    {
+#ifndef NDEBUG
+        unsigned long long made = HeapCheck::allocations() - start;
+        bool steady = frames >= WARMUP_FRAMES;
+        int i = 0;
+        for (const unsigned long long* value = shape.begin(); value != shape.end() && i < SHAPE_VALUES; ++value, i++)
+        {
+            steady = steady && last[i] == *value;
+            last[i] = *value;
+        }
+        frames++;
+        if (steady && made > 0)
+        {
+            LOG_ERROR("ERROR::FRAME::HEAP_ALLOCATIONS {} allocations in a steady-state frame", made);
+            assert(made == 0 && "the frame path allocated from the heap");
+        }
+#else
+        (void)shape;
+#endif
+    }
+
+private:
+    unsigned long long start = 0;
+    unsigned long long last[SHAPE_VALUES] = {};
+    int frames = 0;
+};
+#endif
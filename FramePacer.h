@@ -0,0 +1,137 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GLFW/glfw3.h>
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// Frame pacing: monotonic frame timing, an optional frame rate cap and the swap interval.
+// Times come from the steady clock as integer ticks, so they keep full precision however long the
+// program runs. The cap waits out each frame's remaining time before the swap, sleeping for most of it
+// and spinning the last stretch, since sleeps wake up late by an amount that varies with the OS timer;
+// the spin margin follows the worst oversleep seen so waits stay short when sleeps are accurate.
+// Deadlines advance by exactly one period, so frames keep a steady cadence instead of drifting by the
+// time each wait overshoots. Adaptive vsync syncs to the display but swaps late frames right away
+// (WGL/GLX_EXT_swap_control_tear), trading a tear for a halved frame rate; without the extension it
+// falls back to plain vsync.
+class FramePacer
+{
+public:
+    enum VSync { VSYNC_OFF, VSYNC_ON, VSYNC_ADAPTIVE };
+
+    typedef std::chrono::steady_clock Clock;
+
+    // frames per second to cap at, 0 for no cap
+    int fpsCap = 0;
+
+    FramePacer() : last(Clock::now()), deadline(last)
+    {
+        std::fill(intervals, intervals + HISTORY, 0.0);
+    }
+
+    // sets the swap interval of the current context; returns the mode actually in use
+    VSync setVSync(VSync mode)
+    {
+        if (mode == VSYNC_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+            mode = VSYNC_ON;
+        glfwSwapInterval(mode == VSYNC_OFF ? 0 : (mode == VSYNC_ADAPTIVE ? -1 : 1));
+        vsync = mode;
+        return vsync;
+    }
+
+    VSync vsyncMode() const
+    {
+        return vsync;
+    }
+
+    // call once at the start of every frame; returns the seconds since the previous one
+    double beginFrame()
+    {
+        Clock::time_point now = Clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+        intervals[next] = seconds * 1000.0;
+        next = (next + 1) % HISTORY;
+        filled = std::min(filled + 1, HISTORY);
+        return seconds;
+    }
+
+    // call right before the swap: waits until the cap allows the next frame to be shown
+    void waitForDeadline()
+    {
+        if (fpsCap <= 0)
+        {
+            deadline = Clock::now();
+            return;
+        }
+        TRACE_SCOPE("frame limiter");
+        Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fpsCap));
+        Clock::time_point now = Clock::now();
+        deadline += period;
+        // more than a frame behind, after a hitch or a cap change: start over from now
+        if (deadline + period < now)
+            deadline = now;
+
+        Clock::time_point sleepUntil = deadline - spinMargin;
+        if (now < sleepUntil)
+        {
+            std::this_thread::sleep_until(sleepUntil);
+            Clock::duration late = Clock::now() - sleepUntil;
+            // grow to the worst oversleep at once, shrink back slowly
+            spinMargin = std::max(late + late / 4, spinMargin - spinMargin / 64);
+            spinMargin = std::min(std::max(spinMargin, MIN_SPIN), MAX_SPIN);
+        }
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+
+    // frame interval statistics over the last HISTORY frames, in milliseconds; jitter is the standard
+    // deviation of the interval
+    struct Stats {
+        double mean;
+        double jitter;
+        double worst;
+    };
+
+    Stats stats() const
+    {
+        Stats result = { 0.0, 0.0, 0.0 };
+        if (filled == 0)
+            return result;
+        for (int i = 0; i < filled; i++)
+        {
+            result.mean += intervals[i];
+            result.worst = std::max(result.worst, intervals[i]);
+        }
+        result.mean /= filled;
+        for (int i = 0; i < filled; i++)
+            result.jitter += (intervals[i] - result.mean) * (intervals[i] - result.mean);
+        result.jitter = std::sqrt(result.jitter / filled);
+        return result;
+    }
+
+    // the current spin margin of the limiter, in milliseconds
+    double spinMilliseconds() const
+    {
+        return std::chrono::duration<double, std::milli>(spinMargin).count();
+    }
+
+private:
+    static const int HISTORY = 240;
+    static constexpr Clock::duration MIN_SPIN = std::chrono::microseconds(200);
+    static constexpr Clock::duration MAX_SPIN = std::chrono::milliseconds(4);
+
+    VSync vsync = VSYNC_ON;
+    Clock::time_point last;
+    Clock::time_point deadline;
+    Clock::duration spinMargin = std::chrono::milliseconds(1);
+    double intervals[HISTORY];
+    int next = 0;
+    int filled = 0;
+};
+#endif
@@ -0,0 +1,438 @@
+#ifndef GL_STATS_H
+#define GL_STATS_H
+
+#include <glad/glad.h>
+
+// what one frame submitted to GL
+struct GLFrameCounters {
+    unsigned int draws;
+    // multi-draws whose individual draws are decided on the GPU, counted once per call
+    unsigned int indirectDraws;
+    unsigned int dispatches;
+    unsigned long long triangles;
+    unsigned int programBinds;
+    unsigned int vaoBinds;
+    unsigned int textureBinds;
+    unsigned int bufferBinds;
+    unsigned int uniformCalls;
+    unsigned int uploads;
+    unsigned long long uploadBytes;
+};
+
+// GL call counters.
+// install() swaps glad's function pointers for draws, binds, uniforms and buffer uploads with
+// wrappers that count the call and forward it, so every GL call the engine makes is counted without
+// touching the call sites. ImGui loads its own GL entry points, so the overlay's calls are not
+// included. Triangle counts cover GL_TRIANGLES draws submitted from the CPU; indirect draws only
+// count the call since their instance counts live on the GPU. Texture uploads are not wrapped since
+// their byte counts depend on format and unpack state; the code that streams textures per frame
+// reports them through addUpload(), as do writes into persistently mapped buffers.
+class GLStats
+{
+public:
+    // call once after gladLoadGLLoader
+    static void install()
+    {
+        Originals& original = originals();
+        if (original.installed)
+            return;
+        original.installed = true;
+
+        original.drawArrays = glad_glDrawArrays;
+        glad_glDrawArrays = countedDrawArrays;
+        original.drawElements = glad_glDrawElements;
+        glad_glDrawElements = countedDrawElements;
+        original.drawElementsInstancedBaseVertex = glad_glDrawElementsInstancedBaseVertex;
+        glad_glDrawElementsInstancedBaseVertex = countedDrawElementsInstancedBaseVertex;
+        original.multiDrawElementsIndirect = glad_glMultiDrawElementsIndirect;
+        if (original.multiDrawElementsIndirect != NULL)
+            glad_glMultiDrawElementsIndirect = countedMultiDrawElementsIndirect;
+#if defined(GL_VERSION_4_6)
+        original.multiDrawElementsIndirectCount = glad_glMultiDrawElementsIndirectCount;
+        if (original.multiDrawElementsIndirectCount != NULL)
+            glad_glMultiDrawElementsIndirectCount = countedMultiDrawElementsIndirectCount;
+#endif
+#if defined(GL_ARB_indirect_parameters)
+        original.multiDrawElementsIndirectCountARB = glad_glMultiDrawElementsIndirectCountARB;
+        if (original.multiDrawElementsIndirectCountARB != NULL)
+            glad_glMultiDrawElementsIndirectCountARB = countedMultiDrawElementsIndirectCountARB;
+#endif
+        original.dispatchCompute = glad_glDispatchCompute;
+        if (original.dispatchCompute != NULL)
+            glad_glDispatchCompute = countedDispatchCompute;
+
+        original.useProgram = glad_glUseProgram;
+        glad_glUseProgram = countedUseProgram;
+        original.bindVertexArray = glad_glBindVertexArray;
+        glad_glBindVertexArray = countedBindVertexArray;
+        original.bindTexture = glad_glBindTexture;
+        glad_glBindTexture = countedBindTexture;
+        original.bindBuffer = glad_glBindBuffer;
+        glad_glBindBuffer = countedBindBuffer;
+        original.bindBufferBase = glad_glBindBufferBase;
+        glad_glBindBufferBase = countedBindBufferBase;
+        original.bindBufferRange = glad_glBindBufferRange;
+        glad_glBindBufferRange = countedBindBufferRange;
+
+        original.bufferData = glad_glBufferData;
+        glad_glBufferData = countedBufferData;
+        original.bufferSubData = glad_glBufferSubData;
+        glad_glBufferSubData = countedBufferSubData;
+
+        original.uniform1i = glad_glUniform1i;
+        glad_glUniform1i = countedUniform1i;
+        original.uniform1ui = glad_glUniform1ui;
+        glad_glUniform1ui = countedUniform1ui;
+        original.uniform1f = glad_glUniform1f;
+        glad_glUniform1f = countedUniform1f;
+        original.uniform2i = glad_glUniform2i;
+        glad_glUniform2i = countedUniform2i;
+        original.uniform2f = glad_glUniform2f;
+        glad_glUniform2f = countedUniform2f;
+        original.uniform3f = glad_glUniform3f;
+        glad_glUniform3f = countedUniform3f;
+        original.uniform4f = glad_glUniform4f;
+        glad_glUniform4f = countedUniform4f;
+        original.uniform1fv = glad_glUniform1fv;
+        glad_glUniform1fv = countedUniform1fv;
+        original.uniform1iv = glad_glUniform1iv;
+        glad_glUniform1iv = countedUniform1iv;
+        original.uniform2iv = glad_glUniform2iv;
+        glad_glUniform2iv = countedUniform2iv;
+        original.uniform3iv = glad_glUniform3iv;
+        glad_glUniform3iv = countedUniform3iv;
+        original.uniform4iv = glad_glUniform4iv;
+        glad_glUniform4iv = countedUniform4iv;
+        original.uniform1uiv = glad_glUniform1uiv;
+        glad_glUniform1uiv = countedUniform1uiv;
+        original.uniform2fv = glad_glUniform2fv;
+        glad_glUniform2fv = countedUniform2fv;
+        original.uniform3fv = glad_glUniform3fv;
+        glad_glUniform3fv = countedUniform3fv;
+        original.uniform4fv = glad_glUniform4fv;
+        glad_glUniform4fv = countedUniform4fv;
+        original.uniformMatrix2fv = glad_glUniformMatrix2fv;
+        glad_glUniformMatrix2fv = countedUniformMatrix2fv;
+        original.uniformMatrix3fv = glad_glUniformMatrix3fv;
+        glad_glUniformMatrix3fv = countedUniformMatrix3fv;
+        original.uniformMatrix4fv = glad_glUniformMatrix4fv;
+        glad_glUniformMatrix4fv = countedUniformMatrix4fv;
+    }
+
+    static bool installed()
+    {
+        return originals().installed;
+    }
+
+    // closes the frame being counted and starts a new one
+    static void beginFrame()
+    {
+        state().last = state().current;
+        state().current = GLFrameCounters();
+    }
+
+    // the last complete frame
+    static const GLFrameCounters& lastFrame()
+    {
+        return state().last;
+    }
+
+    // the frame being counted
+    static GLFrameCounters& frame()
+    {
+        return state().current;
+    }
+
+    // uploads that make no GL call, such as writes into a persistently mapped buffer; counted like a
+    // glBufferSubData of the same size
+    static void addUpload(unsigned long long bytes)
+    {
+        if (!installed())
+            return;
+        frame().uploads++;
+        frame().uploadBytes += bytes;
+    }
+
+private:
+    struct State {
+        GLFrameCounters current;
+        GLFrameCounters last;
+    };
+
+    struct Originals {
+        bool installed = false;
+        PFNGLDRAWARRAYSPROC drawArrays;
+        PFNGLDRAWELEMENTSPROC drawElements;
+        PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC drawElementsInstancedBaseVertex;
+        PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect;
+#if defined(GL_VERSION_4_6)
+        PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC multiDrawElementsIndirectCount;
+#endif
+#if defined(GL_ARB_indirect_parameters)
+        PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC multiDrawElementsIndirectCountARB;
+#endif
+        PFNGLDISPATCHCOMPUTEPROC dispatchCompute;
+        PFNGLUSEPROGRAMPROC useProgram;
+        PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+        PFNGLBINDTEXTUREPROC bindTexture;
+        PFNGLBINDBUFFERPROC bindBuffer;
+        PFNGLBINDBUFFERBASEPROC bindBufferBase;
+        PFNGLBINDBUFFERRANGEPROC bindBufferRange;
+        PFNGLBUFFERDATAPROC bufferData;
+        PFNGLBUFFERSUBDATAPROC bufferSubData;
+        PFNGLUNIFORM1IPROC uniform1i;
+        PFNGLUNIFORM1UIPROC uniform1ui;
+        PFNGLUNIFORM1FPROC uniform1f;
+        PFNGLUNIFORM2IPROC uniform2i;
+        PFNGLUNIFORM2FPROC uniform2f;
+        PFNGLUNIFORM3FPROC uniform3f;
+        PFNGLUNIFORM4FPROC uniform4f;
+        PFNGLUNIFORM1FVPROC uniform1fv;
+        PFNGLUNIFORM1IVPROC uniform1iv;
+        PFNGLUNIFORM2IVPROC uniform2iv;
+        PFNGLUNIFORM3IVPROC uniform3iv;
+        PFNGLUNIFORM4IVPROC uniform4iv;
+        PFNGLUNIFORM1UIVPROC uniform1uiv;
+        PFNGLUNIFORM2FVPROC uniform2fv;
+        PFNGLUNIFORM3FVPROC uniform3fv;
+        PFNGLUNIFORM4FVPROC uniform4fv;
+        PFNGLUNIFORMMATRIX2FVPROC uniformMatrix2fv;
+        PFNGLUNIFORMMATRIX3FVPROC uniformMatrix3fv;
+        PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+    };
+
+    static State& state()
+    {
+        static State instance = {};
+        return instance;
+    }
+
+    static Originals& originals()
+    {
+        static Originals instance;
+        return instance;
+    }
+
+    static void countDraw(GLenum mode, GLsizei count, GLsizei instances)
+    {
+        GLFrameCounters& counters = frame();
+        counters.draws++;
+        if (mode == GL_TRIANGLES)
+            counters.triangles += (unsigned long long)(count / 3) * instances;
+    }
+
+    static void APIENTRY countedDrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        countDraw(mode, count, 1);
+        originals().drawArrays(mode, first, count);
+    }
+
+    static void APIENTRY countedDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        countDraw(mode, count, 1);
+        originals().drawElements(mode, count, type, indices);
+    }
+
+    static void APIENTRY countedDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex)
+    {
+        countDraw(mode, count, instancecount);
+        originals().drawElementsInstancedBaseVertex(mode, count, type, indices, instancecount, basevertex);
+    }
+
+    static void APIENTRY countedMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride)
+    {
+        frame().indirectDraws++;
+        originals().multiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+    }
+
+#if defined(GL_VERSION_4_6)
+    static void APIENTRY countedMultiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride)
+    {
+        frame().indirectDraws++;
+        originals().multiDrawElementsIndirectCount(mode, type, indirect, drawcount, maxdrawcount, stride);
+    }
+#endif
+
+#if defined(GL_ARB_indirect_parameters)
+    static void APIENTRY countedMultiDrawElementsIndirectCountARB(GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride)
+    {
+        frame().indirectDraws++;
+        originals().multiDrawElementsIndirectCountARB(mode, type, indirect, drawcount, maxdrawcount, stride);
+    }
+#endif
+
+    static void APIENTRY countedDispatchCompute(GLuint x, GLuint y, GLuint z)
+    {
+        frame().dispatches++;
+        originals().dispatchCompute(x, y, z);
+    }
+
+    static void APIENTRY countedUseProgram(GLuint program)
+    {
+        frame().programBinds++;
+        originals().useProgram(program);
+    }
+
+    static void APIENTRY countedBindVertexArray(GLuint array)
+    {
+        frame().vaoBinds++;
+        originals().bindVertexArray(array);
+    }
+
+    static void APIENTRY countedBindTexture(GLenum target, GLuint texture)
+    {
+        frame().textureBinds++;
+        originals().bindTexture(target, texture);
+    }
+
+    static void APIENTRY countedBindBuffer(GLenum target, GLuint buffer)
+    {
+        frame().bufferBinds++;
+        originals().bindBuffer(target, buffer);
+    }
+
+    static void APIENTRY countedBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        frame().bufferBinds++;
+        originals().bindBufferBase(target, index, buffer);
+    }
+
+    static void APIENTRY countedBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        frame().bufferBinds++;
+        originals().bindBufferRange(target, index, buffer, offset, size);
+    }
+
+    // allocations without data are not uploads
+    static void APIENTRY countedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+    {
+        if (data != NULL)
+        {
+            frame().uploads++;
+            frame().uploadBytes += (unsigned long long)size;
+        }
+        originals().bufferData(target, size, data, usage);
+    }
+
+    static void APIENTRY countedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        frame().uploads++;
+        frame().uploadBytes += (unsigned long long)size;
+        originals().bufferSubData(target, offset, size, data);
+    }
+
+    static void APIENTRY countedUniform1i(GLint location, GLint v0)
+    {
+        frame().uniformCalls++;
+        originals().uniform1i(location, v0);
+    }
+
+    static void APIENTRY countedUniform1ui(GLint location, GLuint v0)
+    {
+        frame().uniformCalls++;
+        originals().uniform1ui(location, v0);
+    }
+
+    static void APIENTRY countedUniform1f(GLint location, GLfloat v0)
+    {
+        frame().uniformCalls++;
+        originals().uniform1f(location, v0);
+    }
+
+    static void APIENTRY countedUniform2i(GLint location, GLint v0, GLint v1)
+    {
+        frame().uniformCalls++;
+        originals().uniform2i(location, v0, v1);
+    }
+
+    static void APIENTRY countedUniform2f(GLint location, GLfloat v0, GLfloat v1)
+    {
+        frame().uniformCalls++;
+        originals().uniform2f(location, v0, v1);
+    }
+
+    static void APIENTRY countedUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+    {
+        frame().uniformCalls++;
+        originals().uniform3f(location, v0, v1, v2);
+    }
+
+    static void APIENTRY countedUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+    {
+        frame().uniformCalls++;
+        originals().uniform4f(location, v0, v1, v2, v3);
+    }
+
+    static void APIENTRY countedUniform1fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform1fv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform1iv(GLint location, GLsizei count, const GLint* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform1iv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform2iv(GLint location, GLsizei count, const GLint* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform2iv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform3iv(GLint location, GLsizei count, const GLint* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform3iv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform4iv(GLint location, GLsizei count, const GLint* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform4iv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform1uiv(GLint location, GLsizei count, const GLuint* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform1uiv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform2fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform2fv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform3fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform3fv(location, count, value);
+    }
+
+    static void APIENTRY countedUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniform4fv(location, count, value);
+    }
+
+    static void APIENTRY countedUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniformMatrix2fv(location, count, transpose, value);
+    }
+
+    static void APIENTRY countedUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniformMatrix3fv(location, count, transpose, value);
+    }
+
+    static void APIENTRY countedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+    {
+        frame().uniformCalls++;
+        originals().uniformMatrix4fv(location, count, transpose, value);
+    }
+};
+#endif
@@ -0,0 +1,251 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+#include "imgui.h"
+#include "FrameArena.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Registry of the GPU memory held by buffers, textures and renderbuffers.
+// Every allocation site reports the object with its size in bytes, the owner that asked for it (a
+// model path, an image file or a subsystem) and a label; re-reporting an object replaces its size, so
+// orphaning a buffer with a new glBufferData is a resize rather than a new allocation. Deleting through
+// deleteBuffers/deleteTextures/deleteRenderbuffers drops the entry. Sizes are what we asked GL for; the
+// driver may pad or compress, so treat the totals as a lower bound of the VRAM used.
+class GpuMemory
+{
+public:
+    enum Kind { BUFFER, TEXTURE, RENDERBUFFER, KIND_COUNT };
+
+    struct Allocation {
+        Kind kind;
+        unsigned int id;
+        unsigned long long bytes;
+        std::string owner;
+        std::string label;
+        // seconds since the registry's first use
+        double created;
+    };
+
+    // records a new allocation, or the new size of an existing one
+    static void track(Kind kind, unsigned int id, unsigned long long bytes, const std::string& owner, const std::string& label)
+    {
+        if (id == 0)
+            return;
+        Registry& registry = instance();
+        std::map<Key, Allocation>::iterator found = registry.allocations.find(Key(kind, id));
+        if (found != registry.allocations.end())
+        {
+            registry.total[kind] -= found->second.bytes;
+            found->second.bytes = bytes;
+            found->second.owner = owner;
+            found->second.label = label;
+        }
+        else
+        {
+            Allocation allocation = { kind, id, bytes, owner, label, now() };
+            registry.allocations[Key(kind, id)] = allocation;
+        }
+        registry.total[kind] += bytes;
+        registry.peak = std::max(registry.peak, totalBytes());
+    }
+
+    static void release(Kind kind, unsigned int id)
+    {
+        Registry& registry = instance();
+        std::map<Key, Allocation>::iterator found = registry.allocations.find(Key(kind, id));
+        if (found == registry.allocations.end())
+            return;
+        registry.total[kind] -= found->second.bytes;
+        registry.allocations.erase(found);
+    }
+
+    // glDelete* that also drops the objects from the registry; zero names are skipped like GL does
+    static void deleteBuffers(int count, const unsigned int* ids)
+    {
+        for (int i = 0; i < count; i++)
+            release(BUFFER, ids[i]);
+        glDeleteBuffers(count, ids);
+    }
+
+    static void deleteTextures(int count, const unsigned int* ids)
+    {
+        for (int i = 0; i < count; i++)
+            release(TEXTURE, ids[i]);
+        glDeleteTextures(count, ids);
+    }
+
+    static void deleteRenderbuffers(int count, const unsigned int* ids)
+    {
+        for (int i = 0; i < count; i++)
+            release(RENDERBUFFER, ids[i]);
+        glDeleteRenderbuffers(count, ids);
+    }
+
+    // bytes of a width x height x layers image, with its full mip chain when mipmapped
+    static unsigned long long textureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmapped)
+    {
+        unsigned long long bytes = 0;
+        for (;;)
+        {
+            bytes += (unsigned long long)width * height * layers * bytesPerTexel;
+            if (!mipmapped || (width == 1 && height == 1))
+                break;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return bytes;
+    }
+
+    static unsigned long long totalBytes(Kind kind)
+    {
+        return instance().total[kind];
+    }
+
+    static unsigned long long totalBytes()
+    {
+        const Registry& registry = instance();
+        unsigned long long total = 0;
+        for (int kind = 0; kind < KIND_COUNT; kind++)
+            total += registry.total[kind];
+        return total;
+    }
+
+    // highest total seen since start
+    static unsigned long long peakBytes()
+    {
+        return instance().peak;
+    }
+
+    // live allocations, largest first
+    static std::vector<Allocation> allocations()
+    {
+        const Registry& registry = instance();
+        std::vector<Allocation> list;
+        list.reserve(registry.allocations.size());
+        for (std::map<Key, Allocation>::const_iterator it = registry.allocations.begin(); it != registry.allocations.end(); ++it)
+            list.push_back(it->second);
+        std::sort(list.begin(), list.end(), largerFirst);
+        return list;
+    }
+
+    // writes the totals and every live allocation, largest first
+    static void dump(std::ostream& out)
+    {
+        std::vector<Allocation> list = allocations();
+        out << "GPU_MEMORY::TOTAL " << megabytes(totalBytes()) << " MB (buffers " << megabytes(totalBytes(BUFFER))
+            << " MB, textures " << megabytes(totalBytes(TEXTURE)) << " MB, renderbuffers " << megabytes(totalBytes(RENDERBUFFER))
+            << " MB), peak " << megabytes(peakBytes()) << " MB, " << list.size() << " objects" << std::endl;
+        double time = now();
+        for (unsigned int i = 0; i < list.size(); i++)
+        {
+            const Allocation& allocation = list[i];
+            char line[64];
+            snprintf(line, sizeof(line), "%10.3f MB %8.1f s  ", megabytes(allocation.bytes), time - allocation.created);
+            out << "  " << line << kindName(allocation.kind) << " " << allocation.id << "  " << allocation.owner
+                << " (" << allocation.label << ")" << std::endl;
+        }
+    }
+
+    // logs the dump as one message
+    static void dump()
+    {
+        std::ostringstream report;
+        dump(report);
+        std::string text = report.str();
+        LOG_INFO("{}", text.substr(0, text.size() - 1));
+    }
+
+    // ImGui window with the totals and a table of the live allocations; the sorted list lives in arena
+    static void drawTable(FrameArena& arena)
+    {
+        ImGui::Begin("GPU memory");
+        ImGui::Text("Total %.2f MB, peak %.2f MB", megabytes(totalBytes()), megabytes(peakBytes()));
+        ImGui::Text("Buffers %.2f MB, textures %.2f MB, renderbuffers %.2f MB", megabytes(totalBytes(BUFFER)),
+                    megabytes(totalBytes(TEXTURE)), megabytes(totalBytes(RENDERBUFFER)));
+        if (ImGui::Button("Dump to log"))
+            dump();
+
+        const Registry& registry = instance();
+        ArenaVector<const Allocation*> list((ArenaAllocator<const Allocation*>(arena)));
+        list.reserve(registry.allocations.size());
+        for (std::map<Key, Allocation>::const_iterator it = registry.allocations.begin(); it != registry.allocations.end(); ++it)
+            list.push_back(&it->second);
+        std::sort(list.begin(), list.end(), [](const Allocation* a, const Allocation* b) { return largerFirst(*a, *b); });
+        double time = now();
+        if (ImGui::BeginTable("allocations", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable, ImVec2(0.0f, 300.0f)))
+        {
+            ImGui::TableSetupColumn("MB");
+            ImGui::TableSetupColumn("Kind");
+            ImGui::TableSetupColumn("Owner");
+            ImGui::TableSetupColumn("Label");
+            ImGui::TableSetupColumn("Age (s)");
+            ImGui::TableHeadersRow();
+            for (unsigned int i = 0; i < list.size(); i++)
+            {
+                const Allocation& allocation = *list[i];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", megabytes(allocation.bytes));
+                ImGui::TableNextColumn();
+                ImGui::Text("%s %u", kindName(allocation.kind), allocation.id);
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", allocation.owner.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", allocation.label.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", time - allocation.created);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+
+    static const char* kindName(Kind kind)
+    {
+        static const char* names[KIND_COUNT] = { "buffer", "texture", "renderbuffer" };
+        return names[kind];
+    }
+
+private:
+    typedef std::pair<int, unsigned int> Key;
+
+    struct Registry {
+        std::map<Key, Allocation> allocations;
+        unsigned long long total[KIND_COUNT] = {};
+        unsigned long long peak = 0;
+    };
+
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    static double now()
+    {
+        static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static double megabytes(unsigned long long bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    static bool largerFirst(const Allocation& a, const Allocation& b)
+    {
+        return a.bytes > b.bytes;
+    }
+};
+#endif
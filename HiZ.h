@@ -0,0 +1,375 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GpuMemory.h"
+#include "JobSystem.h"
+#include "Shader.h"
+#include "ShaderHotReload.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// Hierarchical-Z occlusion culling.
+// After the opaque pass the scene depth is max-reduced on the GPU into a mip pyramid down to a small
+// level, which is read back asynchronously through a ring of pixel buffers. The CPU finishes the
+// pyramid from that level and tests every body's bounding sphere against it in one batch before
+// submission. The depth is one or more frames old, so a body that moves out from behind an occluder
+// can appear a frame late; this is the usual trade for never stalling on the readback.
+class HiZ
+{
+public:
+    bool enabled = true;
+    // optional, tests the bodies in parallel
+    JobSystem* jobs = NULL;
+    unsigned int culledCount = 0;
+
+    // constructor, builds the downsample shader; the pyramid is created on the first resize()
+    HiZ() : downsampleShader("fullscreen.vert", "hiz_downsample.frag")
+    {
+        glGenVertexArrays(1, &emptyVAO);
+        glGenFramebuffers(1, &FBO);
+        glGenBuffers(READBACK_SLOTS, PBO);
+
+        setupDownsample(downsampleShader);
+        glUseProgram(0);
+    }
+
+    // reloads the downsample shader when its files change
+    void watchShaders(ShaderHotReload& reload)
+    {
+        reload.watch(downsampleShader, setupDownsample);
+    }
+
+    HiZ(const HiZ&) = delete;
+    HiZ& operator=(const HiZ&) = delete;
+
+    ~HiZ()
+    {
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+            discardReadback(slot);
+        GpuMemory::deleteBuffers(READBACK_SLOTS, PBO);
+        if (pyramid != 0)
+            GpuMemory::deleteTextures(1, &pyramid);
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    // (re)creates the GPU pyramid for a depth buffer of the given size
+    void resize(int width, int height)
+    {
+        if (width <= 0 || height <= 0 || (width == depthWidth && height == depthHeight))
+            return;
+        depthWidth = width;
+        depthHeight = height;
+
+        // GPU level 0 is half the depth resolution; stop at the first level that is cheap to read back
+        levelSizes.clear();
+        int w = std::max(1, width / 2);
+        int h = std::max(1, height / 2);
+        levelSizes.push_back(glm::ivec2(w, h));
+        while (w > READBACK_MAX_WIDTH)
+        {
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+            levelSizes.push_back(glm::ivec2(w, h));
+        }
+
+        if (pyramid != 0)
+            GpuMemory::deleteTextures(1, &pyramid);
+        glGenTextures(1, &pyramid);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        unsigned long long pyramidBytes = 0;
+        for (unsigned int level = 0; level < levelSizes.size(); level++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelSizes[level].x, levelSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+            pyramidBytes += GpuMemory::textureBytes(levelSizes[level].x, levelSizes[level].y, 1, 4, false);
+        }
+        GpuMemory::track(GpuMemory::TEXTURE, pyramid, pyramidBytes, "HiZ", "depth pyramid");
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        const glm::ivec2 readback = levelSizes.back();
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[slot]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readback.x * readback.y * sizeof(float), NULL, GL_STREAM_READ);
+            GpuMemory::track(GpuMemory::BUFFER, PBO[slot], readback.x * readback.y * sizeof(float), "HiZ", "readback");
+            discardReadback(slot);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // a pyramid of the old size would map bounds to the wrong texels; the new one is reserved here,
+        // the levels below the readback add at most as much again
+        cpuOffsets.clear();
+        cpuSizes.clear();
+        cpuDepths.reserve(2 * readback.x * readback.y);
+        cpuOffsets.reserve(32);
+        cpuSizes.reserve(32);
+    }
+
+    // reduces the given depth texture into the pyramid and queues the readback of its smallest level
+    void build(unsigned int depthTexture, const glm::mat4& view, const glm::mat4& projection)
+    {
+        if (pyramid == 0)
+            return;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        downsampleShader.use();
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        for (unsigned int level = 0; level < levelSizes.size(); level++)
+        {
+            glm::ivec2 sourceSize;
+            if (level == 0)
+            {
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+                sourceSize = glm::ivec2(depthWidth, depthHeight);
+            }
+            else
+            {
+                // restrict sampling to the previous level so reading and writing the same texture is not a feedback loop
+                glBindTexture(GL_TEXTURE_2D, pyramid);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+                sourceSize = levelSizes[level - 1];
+            }
+            glUniform2i(glGetUniformLocation(downsampleShader.ID, "sourceSize"), sourceSize.x, sourceSize.y);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+            glViewport(0, 0, levelSizes[level].x, levelSizes[level].y);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+
+        // the smallest level is still attached, read it into the next pixel buffer without waiting
+        const glm::ivec2 readback = levelSizes.back();
+        discardReadback(nextSlot);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[nextSlot]);
+        glReadPixels(0, 0, readback.x, readback.y, GL_RED, GL_FLOAT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[nextSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotView[nextSlot] = view;
+        slotProjection[nextSlot] = projection;
+        slotSequence[nextSlot] = ++sequence;
+        nextSlot = (nextSlot + 1) % READBACK_SLOTS;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, depthWidth, depthHeight);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+    }
+
+    // tests all bodies against the newest pyramid that has arrived, clearing visible on the hidden ones
+    void cull(std::vector<Body>& bodies)
+    {
+        culledCount = 0;
+        collectReadback();
+
+        const bool ready = enabled && !cpuSizes.empty();
+        std::atomic<unsigned int> culled(0);
+        parallelFor(jobs, (unsigned int)bodies.size(), CULL_GRAIN, [&](unsigned int begin, unsigned int end) {
+            unsigned int hidden = 0;
+            for (unsigned int i = begin; i < end; i++)
+            {
+                bodies[i].visible = !ready || isVisible(bodies[i].bounds);
+                if (!bodies[i].visible)
+                    hidden++;
+            }
+            culled.fetch_add(hidden, std::memory_order_relaxed);
+        });
+        culledCount = culled.load();
+    }
+
+private:
+    static const int READBACK_SLOTS = 3;
+    static const int READBACK_MAX_WIDTH = 256;
+    // bodies tested per job
+    static const unsigned int CULL_GRAIN = 1024;
+
+    Shader downsampleShader;
+    unsigned int emptyVAO = 0;
+    unsigned int FBO = 0;
+    unsigned int pyramid = 0;
+    int depthWidth = 0;
+    int depthHeight = 0;
+    std::vector<glm::ivec2> levelSizes;
+
+    // asynchronous readback ring
+    unsigned int PBO[READBACK_SLOTS];
+    GLsync fences[READBACK_SLOTS] = {};
+    glm::mat4 slotView[READBACK_SLOTS];
+    glm::mat4 slotProjection[READBACK_SLOTS];
+    unsigned long long slotSequence[READBACK_SLOTS] = {};
+    unsigned long long sequence = 0;
+    int nextSlot = 0;
+
+    // CPU pyramid, level 0 is the GPU's smallest level; all levels share one array, rebuilt in place
+    // for every readback so it stops allocating once it has reached its size; depthView/depthProjection
+    // rendered the depth it was built from
+    std::vector<float> cpuDepths;
+    std::vector<unsigned int> cpuOffsets;
+    std::vector<glm::ivec2> cpuSizes;
+    glm::mat4 depthView;
+    glm::mat4 depthProjection;
+
+    // sampler unit, after building the shader and after every reload
+    static void setupDownsample(Shader& shader)
+    {
+        shader.use();
+        shader.setInt("source", 0);
+    }
+
+    void discardReadback(int slot)
+    {
+        if (fences[slot])
+            glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+        slotSequence[slot] = 0;
+    }
+
+    // maps the newest finished readback, never waiting on the GPU
+    void collectReadback()
+    {
+        int newest = -1;
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+        {
+            if (!fences[slot] || (newest >= 0 && slotSequence[slot] < slotSequence[newest]))
+                continue;
+            GLenum status = glClientWaitSync(fences[slot], 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+                newest = slot;
+        }
+        if (newest < 0)
+            return;
+
+        const glm::ivec2 size = levelSizes.back();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[newest]);
+        const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size.x * size.y * sizeof(float), GL_MAP_READ_BIT);
+        if (data)
+        {
+            buildCpuLevels(data, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            depthView = slotView[newest];
+            depthProjection = slotProjection[newest];
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // anything older than the readback just consumed is stale
+        const unsigned long long consumed = slotSequence[newest];
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+            if (fences[slot] && slotSequence[slot] <= consumed)
+                discardReadback(slot);
+    }
+
+    // copies the read back level and finishes the pyramid on the CPU down to a single texel, same
+    // conservative max reduction as the shader
+    void buildCpuLevels(const float* data, glm::ivec2 size)
+    {
+        cpuSizes.assign(1, size);
+        cpuOffsets.assign(1, 0);
+        unsigned int total = size.x * size.y;
+        while (cpuSizes.back().x > 1 || cpuSizes.back().y > 1)
+        {
+            const glm::ivec2 src = cpuSizes.back();
+            cpuOffsets.push_back(total);
+            cpuSizes.push_back(glm::ivec2(std::max(1, src.x / 2), std::max(1, src.y / 2)));
+            total += cpuSizes.back().x * cpuSizes.back().y;
+        }
+        cpuDepths.resize(total);
+        std::copy(data, data + size.x * size.y, cpuDepths.begin());
+
+        for (unsigned int level = 1; level < cpuSizes.size(); level++)
+        {
+            const glm::ivec2 src = cpuSizes[level - 1];
+            const glm::ivec2 dst = cpuSizes[level];
+            const float* source = &cpuDepths[cpuOffsets[level - 1]];
+            float* target = &cpuDepths[cpuOffsets[level]];
+            for (int y = 0; y < dst.y; y++)
+            {
+                int y0 = std::min(y * 2, src.y - 1);
+                int y1 = (y == dst.y - 1) ? src.y - 1 : std::min(y * 2 + 1, src.y - 1);
+                for (int x = 0; x < dst.x; x++)
+                {
+                    int x0 = std::min(x * 2, src.x - 1);
+                    int x1 = (x == dst.x - 1) ? src.x - 1 : std::min(x * 2 + 1, src.x - 1);
+                    float depth = 0.0f;
+                    for (int sy = y0; sy <= y1; sy++)
+                        for (int sx = x0; sx <= x1; sx++)
+                            depth = std::max(depth, source[sy * src.x + sx]);
+                    target[y * dst.x + x] = depth;
+                }
+            }
+        }
+    }
+
+    bool isVisible(const glm::vec4& sphere) const
+    {
+        const glm::vec3 center = glm::vec3(depthView * glm::vec4(glm::vec3(sphere), 1.0f));
+        const float radius = sphere.w;
+
+        // spheres that reach the near plane are always drawn
+        const float nearPlane = depthProjection[3][2] / (depthProjection[2][2] - 1.0f);
+        if (-(center.z + radius) <= nearPlane)
+            return true;
+
+        // screen rectangle of the sphere's view-space bounding box
+        float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p = center + glm::vec3((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+            glm::vec4 clip = depthProjection * glm::vec4(p, 1.0f);
+            minX = std::min(minX, clip.x / clip.w);
+            maxX = std::max(maxX, clip.x / clip.w);
+            minY = std::min(minY, clip.y / clip.w);
+            maxY = std::max(maxY, clip.y / clip.w);
+        }
+
+        // outside the frustum
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+            return false;
+
+        // window depth of the sphere's nearest point
+        glm::vec4 nearest = depthProjection * glm::vec4(0.0f, 0.0f, center.z + radius, 1.0f);
+        const float sphereDepth = nearest.z / nearest.w * 0.5f + 0.5f;
+
+        // full-resolution pixel rectangle, then walk up until it covers at most 2x2 texels
+        int shift = (int)levelSizes.size();
+        int x0 = (int)((std::max(minX, -1.0f) * 0.5f + 0.5f) * (depthWidth - 1)) >> shift;
+        int x1 = (int)((std::min(maxX, 1.0f) * 0.5f + 0.5f) * (depthWidth - 1)) >> shift;
+        int y0 = (int)((std::max(minY, -1.0f) * 0.5f + 0.5f) * (depthHeight - 1)) >> shift;
+        int y1 = (int)((std::min(maxY, 1.0f) * 0.5f + 0.5f) * (depthHeight - 1)) >> shift;
+        unsigned int level = 0;
+        while ((x1 - x0 > 1 || y1 - y0 > 1) && level + 1 < cpuSizes.size())
+        {
+            x0 >>= 1; x1 >>= 1; y0 >>= 1; y1 >>= 1;
+            level++;
+        }
+
+        const glm::ivec2 size = cpuSizes[level];
+        const float* depths = &cpuDepths[cpuOffsets[level]];
+        float farthest = 0.0f;
+        for (int y = std::min(y0, size.y - 1); y <= std::min(y1, size.y - 1); y++)
+            for (int x = std::min(x0, size.x - 1); x <= std::min(x1, size.x - 1); x++)
+                farthest = std::max(farthest, depths[y * size.x + x]);
+
+        return sphereDepth <= farthest;
+    }
+};
+#endif
@@ -0,0 +1,262 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// counts the unfinished jobs of a group; JobSystem::wait() returns once it reaches zero
+typedef std::atomic<int> JobCounter;
+
+// Work-stealing job system for short per-frame work.
+// Every worker owns a fixed ring of jobs: it pushes and pops its own end (newest first, still warm in
+// cache) while idle workers steal from the other end (oldest first, usually the largest remaining
+// work). Threads that are not workers, like the main thread, share one extra queue. A job is a plain
+// function pointer with a context and an index range, so submitting one never allocates.
+// Dependencies are expressed with counters: run() jobs against a counter, then wait() on it before
+// starting what depends on them. A waiting thread keeps executing other jobs instead of blocking, so
+// jobs may themselves submit and wait. Idle workers spin briefly and then sleep until work arrives.
+class JobSystem
+{
+public:
+    struct Job {
+        void (*function)(const void* context, unsigned int begin, unsigned int end);
+        const void* context;
+        unsigned int begin;
+        unsigned int end;
+        // decremented once the job has run, may be NULL
+        JobCounter* counter;
+    };
+
+    // jobs a queue holds; when full the submitting thread runs the job itself
+    static const unsigned int QUEUE_CAPACITY = 4096;
+
+    // threads = 0 uses one worker per hardware thread besides the caller's
+    explicit JobSystem(unsigned int threads = 0) : queues((threads == 0 ? std::max(2u, std::thread::hardware_concurrency()) - 1 : threads) + 1)
+    {
+        for (unsigned int i = 1; i < queues.size(); i++)
+            workers.push_back(std::thread(&JobSystem::work, this, i));
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    // threads that execute jobs, counting the one that waits
+    unsigned int threadCount() const
+    {
+        return (unsigned int)queues.size();
+    }
+
+    // queues a job on the calling thread's queue
+    void run(const Job& job)
+    {
+        if (job.counter != NULL)
+            job.counter->fetch_add(1, std::memory_order_relaxed);
+        pending.fetch_add(1, std::memory_order_seq_cst);
+        if (!queues[ownQueue()].push(job))
+        {
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            execute(job);
+            return;
+        }
+        if (sleeping.load(std::memory_order_seq_cst) > 0)
+        {
+            // pairs with the predicate check in work(), so the wakeup cannot be lost
+            { std::lock_guard<std::mutex> lock(sleepMutex); }
+            wake.notify_one();
+        }
+    }
+
+    // executes queued jobs until counter reaches zero
+    void wait(const JobCounter& counter)
+    {
+        while (counter.load(std::memory_order_acquire) > 0)
+        {
+            if (!runOne(ownQueue()))
+                std::this_thread::yield();
+        }
+    }
+
+    // calls body(begin, end) over [0, count) split into chunks of grain items, chunk k covering
+    // [k * grain, (k + 1) * grain), and returns when all are done; small counts run inline
+    template <typename Body>
+    void parallelFor(unsigned int count, unsigned int grain, const Body& body)
+    {
+        grain = std::max(1u, grain);
+        if (count <= grain || queues.size() == 1)
+        {
+            if (count > 0)
+                body(0u, count);
+            return;
+        }
+        JobCounter counter(0);
+        // the caller takes the first chunk itself
+        for (unsigned int begin = grain; begin < count; begin += grain)
+        {
+            Job job = { &invoke<Body>, &body, begin, std::min(count, begin + grain), &counter };
+            run(job);
+        }
+        body(0u, grain);
+        wait(counter);
+    }
+
+private:
+    // fixed ring behind a spin lock; the owner uses the back, thieves the front
+    struct Queue {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        unsigned int head = 0;
+        unsigned int tail = 0;
+        Job jobs[QUEUE_CAPACITY];
+
+        bool push(const Job& job)
+        {
+            lock();
+            bool full = tail - head == QUEUE_CAPACITY;
+            if (!full)
+                jobs[tail++ % QUEUE_CAPACITY] = job;
+            unlock();
+            return !full;
+        }
+
+        bool popBack(Job& job)
+        {
+            lock();
+            bool found = tail != head;
+            if (found)
+                job = jobs[--tail % QUEUE_CAPACITY];
+            unlock();
+            return found;
+        }
+
+        bool popFront(Job& job)
+        {
+            lock();
+            bool found = tail != head;
+            if (found)
+                job = jobs[head++ % QUEUE_CAPACITY];
+            unlock();
+            return found;
+        }
+
+        void lock()
+        {
+            while (busy.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+
+        void unlock()
+        {
+            busy.clear(std::memory_order_release);
+        }
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> pending{ 0 };
+    std::atomic<int> sleeping{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    template <typename Body>
+    static void invoke(const void* context, unsigned int begin, unsigned int end)
+    {
+        (*static_cast<const Body*>(context))(begin, end);
+    }
+
+    // the system the calling thread is a worker of, and its queue there
+    struct WorkerSlot {
+        const JobSystem* system;
+        unsigned int index;
+    };
+
+    static WorkerSlot& workerSlot()
+    {
+        thread_local WorkerSlot slot = { NULL, 0 };
+        return slot;
+    }
+
+    // queue of the calling thread; every thread that is not one of our workers shares queue 0
+    unsigned int ownQueue() const
+    {
+        const WorkerSlot& slot = workerSlot();
+        return slot.system == this ? slot.index : 0;
+    }
+
+    static void execute(const Job& job)
+    {
+        job.function(job.context, job.begin, job.end);
+        if (job.counter != NULL)
+            job.counter->fetch_sub(1, std::memory_order_release);
+    }
+
+    // runs the newest job of our own queue, or steals the oldest of another; false if all are empty
+    bool runOne(unsigned int own)
+    {
+        Job job;
+        bool found = queues[own].popBack(job);
+        for (unsigned int i = 1; !found && i < queues.size(); i++)
+            found = queues[(own + i) % queues.size()].popFront(job);
+        if (!found)
+            return false;
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        return true;
+    }
+
+    void work(unsigned int index)
+    {
+        workerSlot().system = this;
+        workerSlot().index = index;
+        Trace::setThreadName("job " + std::to_string(index));
+        for (;;)
+        {
+            if (runOne(index))
+                continue;
+            // spin a little before sleeping, frames hand out work in quick bursts
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; spin++)
+            {
+                std::this_thread::yield();
+                found = pending.load(std::memory_order_relaxed) > 0;
+            }
+            if (found)
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            wake.wait(lock, [this]() { return stopping || pending.load(std::memory_order_seq_cst) > 0; });
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+            if (stopping)
+                return;
+        }
+    }
+};
+
+// jobs->parallelFor, or the whole range inline when jobs is NULL
+template <typename Body>
+inline void parallelFor(JobSystem* jobs, unsigned int count, unsigned int grain, const Body& body)
+{
+    if (jobs != NULL)
+        jobs->parallelFor(count, grain, body);
+    else if (count > 0)
+        body(0u, count);
+}
+#endif
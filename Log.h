@@ -0,0 +1,119 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Levels below SPDLOG_ACTIVE_LEVEL are removed by the preprocessor together with their arguments, so
+// release builds carry no debug logging at all. Must be set before spdlog is included anywhere.
+#ifndef SPDLOG_ACTIVE_LEVEL
+#ifdef NDEBUG
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#else
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_DEBUG
+#endif
+#endif
+
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Logging on spdlog's asynchronous logger.
+// A call only formats the message and pushes it into a ring buffer preallocated by init(); a
+// background thread writes it out. When the ring is full the oldest queued message is overwritten
+// instead of waiting, so logging from the render loop never blocks on the console or a file.
+// Before init() (e.g. in the benchmarks) the macros go to spdlog's default synchronous logger.
+#define LOG_TRACE(...) SPDLOG_TRACE(__VA_ARGS__)
+#define LOG_DEBUG(...) SPDLOG_DEBUG(__VA_ARGS__)
+#define LOG_INFO(...) SPDLOG_INFO(__VA_ARGS__)
+#define LOG_WARN(...) SPDLOG_WARN(__VA_ARGS__)
+#define LOG_ERROR(...) SPDLOG_ERROR(__VA_ARGS__)
+
+// logs at most once per interval from this call site, e.g. LOG_EVERY(1.0, WARN, "...", ...), and
+// reports how many messages were dropped in between
+#define LOG_EVERY(seconds, level, ...)                                              \
+    do {                                                                            \
+        static LogRateLimit logRateLimit(seconds);                                  \
+        unsigned int logSuppressed = 0;                                             \
+        if (logRateLimit.allow(logSuppressed))                                      \
+        {                                                                           \
+            LOG_##level(__VA_ARGS__);                                               \
+            if (logSuppressed > 0)                                                  \
+                LOG_##level("({} similar messages suppressed)", logSuppressed);     \
+        }                                                                           \
+    } while (0)
+
+class Log
+{
+public:
+    // messages the ring holds before the oldest are overwritten
+    static const size_t QUEUE_SIZE = 8192;
+
+    // replaces the default logger with the asynchronous one, also writing to file when one is given
+    static void init(const std::string& file = "")
+    {
+        spdlog::init_thread_pool(QUEUE_SIZE, 1);
+        std::vector<spdlog::sink_ptr> sinks;
+        sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+        if (!file.empty())
+            sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(file, true));
+        std::shared_ptr<spdlog::logger> logger = std::make_shared<spdlog::async_logger>("solar_system", sinks.begin(), sinks.end(),
+            spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
+        logger->set_level((spdlog::level::level_enum)SPDLOG_ACTIVE_LEVEL);
+        logger->set_pattern("[%H:%M:%S.%e] [%^%l%$] %v");
+        // errors are written out as soon as the worker reaches them, in case a crash follows
+        logger->flush_on(spdlog::level::err);
+        spdlog::set_default_logger(logger);
+    }
+
+    // writes out everything still queued and stops the worker thread
+    static void shutdown()
+    {
+        spdlog::shutdown();
+    }
+};
+
+// initializes logging for the rest of the enclosing block, e.g. main
+class LogSession
+{
+public:
+    explicit LogSession(const std::string& file = "")
+    {
+        Log::init(file);
+    }
+
+    ~LogSession()
+    {
+        Log::shutdown();
+    }
+};
+
+// lets one message through per interval, counting the ones it drops; safe to share between threads
+class LogRateLimit
+{
+public:
+    explicit LogRateLimit(double seconds) : interval((long long)(seconds * 1.0e6)), next(0), dropped(0) {}
+
+    bool allow(unsigned int& suppressed)
+    {
+        long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        long long allowedAt = next.load(std::memory_order_relaxed);
+        if (now < allowedAt || !next.compare_exchange_strong(allowedAt, now + interval, std::memory_order_relaxed))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = dropped.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    long long interval;
+    std::atomic<long long> next;
+    std::atomic<unsigned int> dropped;
+};
+#endif
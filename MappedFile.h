@@ -0,0 +1,138 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "Log.h"
+
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read-only into memory. The OS pages it in on first touch and can drop clean
+// pages again under memory pressure, so mapping a file much larger than what is read from it costs
+// little; reading a page that is not resident blocks on the disk, which is why callers touch the
+// data from a worker thread. Any thread may read concurrently once it is open.
+class MappedFile
+{
+public:
+    MappedFile() {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : bytes(other.bytes), length(other.length)
+#if defined(_WIN32)
+        , file(other.file), mapping(other.mapping)
+#endif
+    {
+        other.bytes = NULL;
+        other.length = 0;
+#if defined(_WIN32)
+        other.file = INVALID_HANDLE_VALUE;
+        other.mapping = NULL;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // maps path, replacing any file mapped before; returns false and logs if it cannot be mapped
+    bool open(const std::string& path)
+    {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+        {
+            LOG_ERROR("ERROR::MAPPED_FILE::OPEN_FAILED {}", path);
+            close();
+            return false;
+        }
+        length = (size_t)size.QuadPart;
+        if (length > 0)
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL)
+                bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (descriptor < 0 || fstat(descriptor, &info) != 0)
+        {
+            LOG_ERROR("ERROR::MAPPED_FILE::OPEN_FAILED {}", path);
+            if (descriptor >= 0)
+                ::close(descriptor);
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0)
+        {
+            void* address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address != MAP_FAILED)
+                bytes = (const unsigned char*)address;
+        }
+        // the mapping keeps its own reference to the file
+        ::close(descriptor);
+#endif
+        if (length > 0 && bytes == NULL)
+        {
+            LOG_ERROR("ERROR::MAPPED_FILE::MAP_FAILED {}", path);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (bytes != NULL)
+            UnmapViewOfFile(bytes);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes != NULL)
+            munmap((void*)bytes, length);
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    // the file's contents, NULL when nothing is mapped or the file is empty
+    const unsigned char* data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const unsigned char* bytes = NULL;
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+#endif
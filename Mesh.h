@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\Shader.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\GpuMemory.h"
 
 #include <string>
 #include <vector>
@@ -44,54 +45,61 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // what the buffers are reported under in GpuMemory, usually the model path
+    string owner;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; with upload false no GL call is made, so the mesh can be built on any thread and
+    // uploaded later with upload() on the GL thread
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const string& owner = "mesh", bool upload = true)
+        : VAO(0), VBO(0), EBO(0)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->owner = owner;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (upload)
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // a mesh owns its GL objects, so it can be moved but not copied; textures belong to the Model
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept : vertices(std::move(other.vertices)), indices(std::move(other.indices)),
+        textures(std::move(other.textures)), VAO(other.VAO), owner(std::move(other.owner)), VBO(other.VBO), EBO(other.EBO)
+    {
+        other.VAO = other.VBO = other.EBO = 0;
+    }
+
+    Mesh& operator=(Mesh&& other) noexcept
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
+        if (this != &other)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            releaseBuffers();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            owner = std::move(other.owner);
+            VAO = other.VAO;
+            VBO = other.VBO;
+            EBO = other.EBO;
+            other.VAO = other.VBO = other.EBO = 0;
         }
+        return *this;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    ~Mesh()
+    {
+        releaseBuffers();
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // creates the GL buffers of a mesh built without them; needs a current context
+    void upload()
+    {
+        if (VAO == 0)
+            setupMesh();
     }
 
 private:
@@ -113,9 +121,11 @@ private:
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        GpuMemory::track(GpuMemory::BUFFER, VBO, vertices.size() * sizeof(Vertex), owner, "mesh vertices");
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        GpuMemory::track(GpuMemory::BUFFER, EBO, indices.size() * sizeof(unsigned int), owner, "mesh indices");
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -142,5 +152,15 @@ private:
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
     }
+
+    void releaseBuffers()
+    {
+        if (VAO == 0)
+            return;
+        const unsigned int buffers[2] = { VBO, EBO };
+        GpuMemory::deleteBuffers(2, buffers);
+        glDeleteVertexArrays(1, &VAO);
+        VAO = VBO = EBO = 0;
+    }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,293 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Post-load index/vertex buffer optimization.
+//  1. vertex cache: Tipsify (Sander, Nehab & Barczak 2007) reorders triangles so they reuse recently
+//     transformed vertices, remembering where it had to jump to a new region (cache flushes)
+//  2. overdraw: the Tipsify output is cut into clusters at those jumps and wherever a cluster's own ACMR
+//     is already good enough, and clusters facing away from the mesh center are drawn first
+//  3. vertex fetch: vertices are renumbered in order of first use so fetches walk memory linearly
+// ACMR (average cache miss ratio) is the number of vertex shader invocations per triangle for a FIFO
+// cache of the given size: 3.0 is the worst case, 0.5 the ideal for large regular meshes.
+
+const unsigned int MESH_OPTIMIZER_CACHE_SIZE = 16;
+
+struct MeshOptimizerStats {
+    float acmrBefore;
+    float acmrAfter;
+    unsigned int clusters;
+};
+
+// average cache miss ratio of a triangle list on a FIFO post-transform cache
+inline float computeACMR(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int misses = 0, time = 0;
+    for (unsigned int i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        // a vertex is cached if it was inserted within the last cacheSize misses
+        if (timestamp[v] == 0 || time - timestamp[v] >= cacheSize)
+        {
+            misses++;
+            timestamp[v] = ++time;
+        }
+    }
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+// Tipsify: returns the new triangle order and, in hardBoundaries, the output triangle positions where
+// the fan jumped to a vertex outside the cache
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<unsigned int>& hardBoundaries, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    const unsigned int triangleCount = (unsigned int)indices.size() / 3;
+
+    // vertex -> triangle adjacency in compressed rows
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (unsigned int i = 0; i < indices.size(); i++)
+        live[indices[i]]++;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; t++)
+        for (unsigned int j = 0; j < 3; j++)
+            adjacency[fill[indices[t * 3 + j]]++] = t;
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    hardBoundaries.clear();
+
+    unsigned int time = cacheSize + 1;
+    unsigned int cursor = 0;
+    int fanning = vertexCount > 0 ? 0 : -1;
+    while (fanning >= 0)
+    {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (unsigned int j = 0; j < 3; j++)
+            {
+                unsigned int v = indices[t * 3 + j];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        // next fanning vertex: the one still in cache with the most remaining work that will not be evicted
+        int next = -1;
+        int best = -1;
+        for (unsigned int c = 0; c < candidates.size(); c++)
+        {
+            unsigned int v = candidates[c];
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > best)
+            {
+                best = priority;
+                next = (int)v;
+            }
+        }
+
+        if (next < 0)
+        {
+            // dead end: prefer a recently used vertex, otherwise scan forward for any vertex with work left
+            while (!deadEnd.empty() && next < 0)
+            {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = (int)v;
+            }
+            while (next < 0 && cursor < vertexCount)
+            {
+                if (live[cursor] > 0)
+                    next = (int)cursor;
+                cursor++;
+            }
+            if (next >= 0)
+                hardBoundaries.push_back((unsigned int)output.size() / 3);
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+// reorders the Tipsify clusters so outward facing ones are drawn first, which lets early depth testing
+// reject more of the surfaces behind them; returns the number of clusters
+inline unsigned int optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& hardBoundaries, float threshold = 1.05f, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    const unsigned int triangleCount = (unsigned int)indices.size() / 3;
+    if (triangleCount == 0)
+        return 0;
+
+    // soft boundaries: inside each hard cluster, end a cluster as soon as its own ACMR (starting from a cold
+    // cache) is within threshold of the whole mesh's, so splitting costs little vertex reuse
+    const float target = computeACMR(indices, (unsigned int)positions.size(), cacheSize) * threshold;
+    std::vector<unsigned char> hardStart(triangleCount + 1, 0);
+    for (unsigned int i = 0; i < hardBoundaries.size(); i++)
+        hardStart[std::min(hardBoundaries[i], triangleCount)] = 1;
+
+    std::vector<unsigned int> starts(1, 0);
+    std::vector<unsigned int> cacheTime(positions.size(), 0);
+    unsigned int time = cacheSize + 1;
+    unsigned int clusterStart = 0;
+    unsigned int misses = 0;
+    for (unsigned int t = 0; t < triangleCount; t++)
+    {
+        if (t > clusterStart && hardStart[t])
+        {
+            // advancing the clock past the cache size starts the new cluster with a cold cache
+            starts.push_back(t);
+            clusterStart = t;
+            misses = 0;
+            time += cacheSize + 1;
+        }
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            unsigned int v = indices[t * 3 + j];
+            if (time - cacheTime[v] > cacheSize)
+            {
+                misses++;
+                cacheTime[v] = time++;
+            }
+        }
+        unsigned int length = t - clusterStart + 1;
+        if (length >= 8 && t + 1 < triangleCount && (float)misses / length <= target)
+        {
+            starts.push_back(t + 1);
+            clusterStart = t + 1;
+            misses = 0;
+            time += cacheSize + 1;
+        }
+    }
+    starts.push_back(triangleCount);
+
+    // sort key: how far the cluster sits out along its own facing direction
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCenter(starts.size() - 1, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(starts.size() - 1, glm::vec3(0.0f));
+    std::vector<float> clusterArea(starts.size() - 1, 0.0f);
+    for (unsigned int c = 0; c + 1 < starts.size(); c++)
+    {
+        for (unsigned int i = starts[c]; i < starts[c + 1]; i++)
+        {
+            const glm::vec3& a = positions[indices[i * 3 + 0]];
+            const glm::vec3& b = positions[indices[i * 3 + 1]];
+            const glm::vec3& d = positions[indices[i * 3 + 2]];
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal) * 0.5f;
+            glm::vec3 centroid = (a + b + d) / 3.0f;
+            clusterCenter[c] += centroid * area;
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+            meshCenter += centroid * area;
+            meshArea += area;
+        }
+    }
+    if (meshArea > 0.0f)
+        meshCenter /= meshArea;
+
+    std::vector<float> key(starts.size() - 1, 0.0f);
+    std::vector<unsigned int> order(starts.size() - 1);
+    for (unsigned int c = 0; c < order.size(); c++)
+    {
+        order[c] = c;
+        float normalLength = glm::length(clusterNormal[c]);
+        if (clusterArea[c] > 0.0f && normalLength > 0.0f)
+            key[c] = glm::dot(clusterCenter[c] / clusterArea[c] - meshCenter, clusterNormal[c] / normalLength);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return key[a] > key[b]; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (unsigned int c = 0; c < order.size(); c++)
+        output.insert(output.end(), indices.begin() + starts[order[c]] * 3, indices.begin() + starts[order[c] + 1] * 3);
+    indices.swap(output);
+    return (unsigned int)order.size();
+}
+
+// renumbers vertices in order of first use; unreferenced vertices keep their relative order at the end
+template <typename VertexType>
+inline void optimizeVertexFetch(std::vector<VertexType>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), ~0u);
+    std::vector<VertexType> output;
+    output.reserve(vertices.size());
+    for (unsigned int i = 0; i < indices.size(); i++)
+    {
+        unsigned int& target = remap[indices[i]];
+        if (target == ~0u)
+        {
+            target = (unsigned int)output.size();
+            output.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+    for (unsigned int v = 0; v < vertices.size(); v++)
+    {
+        if (remap[v] == ~0u)
+            output.push_back(vertices[v]);
+    }
+    vertices.swap(output);
+}
+
+// runs all three passes on a triangle list of vertices with a Position member
+template <typename VertexType>
+inline MeshOptimizerStats optimizeMesh(std::vector<VertexType>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizerStats stats = {};
+    const unsigned int vertexCount = (unsigned int)vertices.size();
+    stats.acmrBefore = computeACMR(indices, vertexCount);
+    if (indices.size() % 3 != 0 || indices.empty())
+    {
+        stats.acmrAfter = stats.acmrBefore;
+        return stats;
+    }
+
+    std::vector<unsigned int> original = indices;
+    std::vector<unsigned int> hardBoundaries;
+    optimizeVertexCache(indices, vertexCount, hardBoundaries);
+
+    std::vector<glm::vec3> positions(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        positions[v] = vertices[v].Position;
+    stats.clusters = optimizeOverdraw(indices, positions, hardBoundaries);
+    // already well ordered meshes (e.g. thin rings) can come out slightly worse, keep their order then
+    if (computeACMR(indices, vertexCount) > stats.acmrBefore)
+    {
+        indices.swap(original);
+        stats.clusters = 1;
+    }
+
+    optimizeVertexFetch(vertices, indices);
+    stats.acmrAfter = computeACMR(indices, vertexCount);
+    return stats;
+}
+#endif
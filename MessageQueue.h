@@ -0,0 +1,32 @@
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Messages from any thread to one consumer. The lock is only held to append a message or to swap
+// the whole pending list out, so neither side blocks the other for longer than that.
+template <typename T>
+class MessageQueue
+{
+public:
+    void post(const T& message)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(message);
+    }
+
+    // moves every message posted so far into messages, oldest first, replacing its contents
+    void drain(std::vector<T>& messages)
+    {
+        messages.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(messages, pending);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<T> pending;
+};
+#endif
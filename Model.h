@@ -12,15 +12,34 @@
 
 #include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\Mesh.h"
 #include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\Shader.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\GpuMemory.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\Log.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\MeshOptimizer.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\ObjLoader.h"
+#include "C:\Users\milen\Documents\GitHub\assignment-2-the-solar-system-00mila00\build\src\Trace.h"
 
+#include <cctype>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
+// an image decoded on the CPU that has not become a texture yet, see DecodeImage and TextureFromImage
+struct DecodedImage {
+    string path;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // NULL when decoding failed
+    std::shared_ptr<unsigned char> pixels;
+};
+
+DecodedImage DecodeImage(const char* path, int components = 0);
+unsigned int TextureFromImage(const DecodedImage& image);
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
 class Model
@@ -30,41 +49,126 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
+    // file the model was loaded from, its meshes' buffers are reported under it in GpuMemory
+    string path;
     bool gammaCorrection;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. With upload false the model is only parsed and its
+    // textures decoded, which needs no GL context and can run on any thread; upload() finishes it.
+    Model(string const& path, bool gamma = false, bool upload = true) : gammaCorrection(gamma), deferred(!upload)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // the meshes free their own buffers, the textures are shared between them and freed here; a
+    // moved-from model is left without textures so only the new one frees them
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) = default;
+
+    ~Model()
     {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            GpuMemory::deleteTextures(1, &textures_loaded[i].id);
+    }
+
+    // creates the textures and buffers of a model loaded with upload = false; needs a current context
+    void upload()
+    {
+        for (unsigned int i = 0; i < pendingImages.size(); i++)
+        {
+            unsigned int id = TextureFromImage(pendingImages[i]);
+            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            {
+                if (textures_loaded[j].path == pendingImages[i].path)
+                    textures_loaded[j].id = id;
+            }
+            for (unsigned int m = 0; m < meshes.size(); m++)
+            {
+                for (unsigned int j = 0; j < meshes[m].textures.size(); j++)
+                {
+                    if (meshes[m].textures[j].path == pendingImages[i].path)
+                        meshes[m].textures[j].id = id;
+                }
+            }
+        }
+        pendingImages.clear();
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].upload();
+        deferred = false;
     }
 
-private:
+    // radius of the model's bounding sphere around its local origin
+    float boundingRadius() const
+    {
+        float radius = 0.0f;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            for (unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+                radius = glm::max(radius, glm::length(meshes[i].vertices[j].Position));
+        return radius;
+    }
+
+    // the loading stages are public so the benchmarks can time them on their own
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
+        TRACE_SCOPE("load model");
+        // Wavefront OBJ, the format of every shipped model, has its own faster parser; Assimp reads
+        // the rest, and any OBJ that parser gives up on
+        if (isObj(path))
+        {
+            if (loadObj(path))
+                return;
+            LOG_WARN("OBJ::FALLBACK {} is imported with Assimp", path);
+        }
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            LOG_ERROR("ERROR::ASSIMP:: {}", importer.GetErrorString());
             return;
         }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        this->path = path;
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
     }
 
+    // loads an OBJ through ObjLoader into the same meshes and textures the Assimp import gives;
+    // returns false, with nothing loaded, if the file could not be parsed
+    bool loadObj(string const& path)
+    {
+        ObjModel obj;
+        if (!ObjLoader::load(path, obj))
+            return false;
+        directory = path.substr(0, path.find_last_of('/'));
+        this->path = path;
+
+        for (unsigned int i = 0; i < obj.meshes.size(); i++)
+        {
+            // the same sampler names as the Assimp material slots in processMesh
+            vector<Texture> textures;
+            if (obj.meshes[i].material >= 0)
+            {
+                const ObjMaterial& material = obj.materials[obj.meshes[i].material];
+                if (!material.diffuse.empty())
+                    textures.push_back(loadTexture(material.diffuse.c_str(), "texture_diffuse"));
+                if (!material.specular.empty())
+                    textures.push_back(loadTexture(material.specular.c_str(), "texture_specular"));
+                if (!material.normal.empty())
+                    textures.push_back(loadTexture(material.normal.c_str(), "texture_normal"));
+                if (!material.height.empty())
+                    textures.push_back(loadTexture(material.height.c_str(), "texture_height"));
+            }
+            meshes.push_back(createMesh(obj.meshes[i].vertices, obj.meshes[i].indices, textures));
+        }
+        return true;
+    }
+
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
     void processNode(aiNode* node, const aiScene* scene)
     {
@@ -86,6 +190,7 @@ private:
 
     Mesh processMesh(aiMesh* mesh, const aiScene* scene)
     {
+        TRACE_SCOPE("process mesh");
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
@@ -165,7 +270,30 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return createMesh(vertices, indices, textures);
+    }
+
+private:
+    // set while the model is loaded without GL, textures then wait in pendingImages for upload()
+    bool deferred;
+    vector<DecodedImage> pendingImages;
+
+    static bool isObj(string const& path)
+    {
+        if (path.size() < 4)
+            return false;
+        string extension = path.substr(path.size() - 4);
+        for (unsigned int i = 0; i < extension.size(); i++)
+            extension[i] = (char)tolower((unsigned char)extension[i]);
+        return extension == ".obj";
+    }
+
+    Mesh createMesh(vector<Vertex>& vertices, vector<unsigned int>& indices, const vector<Texture>& textures)
+    {
+        // reorder for the post-transform vertex cache, overdraw and vertex fetch before upload
+        MeshOptimizerStats stats = optimizeMesh(vertices, indices);
+        LOG_INFO("OPTIMIZE::MESH {} mesh {} ACMR {} -> {} ({} clusters)", path, meshes.size(), stats.acmrBefore, stats.acmrAfter, stats.clusters);
+        return Mesh(vertices, indices, textures, path, !deferred);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -189,57 +317,89 @@ private:
                 }
             }
             if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+                textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // the texture of file, loaded once per model and shared through textures_loaded afterwards
+    Texture loadTexture(const char* file, const string& typeName)
+    {
+        for (unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if (textures_loaded[j].path == file)
+                return textures_loaded[j];
+        }
+        Texture texture;
+        if (deferred)
+        {
+            texture.id = 0;
+            pendingImages.push_back(DecodeImage(file));
+        }
+        else
+            texture.id = TextureFromFile(file, this->directory);
+        texture.type = typeName;
+        texture.path = file;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+DecodedImage DecodeImage(const char* path, int components)
 {
-    string filename = string(path);
-    //filename = directory + '/' + filename;
+    TRACE_SCOPE("decode image");
+    DecodedImage image;
+    image.path = path;
+    unsigned char* data = stbi_load(path, &image.width, &image.height, &image.components, components);
+    if (data)
+    {
+        if (components != 0)
+            image.components = components;
+        image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+    }
+    else
+        LOG_ERROR("Texture failed to load at path: {}", path);
+    return image;
+}
 
+unsigned int TextureFromImage(const DecodedImage& image)
+{
+    TRACE_SCOPE("upload texture");
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.pixels)
     {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.components == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.components == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.components == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
         glGenerateMipmap(GL_TEXTURE_2D);
+        // three-channel images are padded to four bytes per texel by most drivers
+        GpuMemory::track(GpuMemory::TEXTURE, textureID, GpuMemory::textureBytes(image.width, image.height, 1, image.components == 3 ? 4 : image.components, true), image.path, "model texture");
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
 }
-#endif
\ No newline at end of file
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+{
+    TRACE_SCOPE("load texture");
+    string filename = string(path);
+    //filename = directory + '/' + filename;
+
+    return TextureFromImage(DecodeImage(filename.c_str()));
+}
+#endif
@@ -0,0 +1,193 @@
+#ifndef OIT_H
+#define OIT_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "Log.h"
+#include "Shader.h"
+#include "ShaderHotReload.h"
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013).
+// Opaque geometry is rendered into an offscreen scene target, translucent geometry is accumulated into
+// an accumulation and a revealage target that share the scene depth buffer, and a fullscreen pass
+// composites the weighted average over the opaque image. No CPU sorting is needed.
+//
+// Only a single glBlendFuncSeparate is used for both targets, so this runs on a 3.3 core context:
+//   accumTexture  (RGBA16F): rgb += premultiplied color * weight, a = product of (1 - alpha) (revealage)
+//   weightTexture (R16F)   : r   += alpha * weight
+class OIT
+{
+public:
+    unsigned int sceneFBO = 0;
+    unsigned int sceneColor = 0;
+    unsigned int accumFBO = 0;
+    unsigned int accumTexture = 0;
+    unsigned int weightTexture = 0;
+    unsigned int depthTexture = 0;
+    int width = 0;
+    int height = 0;
+    // composite() copies the final image here, 0 is the window
+    unsigned int outputFBO = 0;
+
+    // constructor, builds the composite shader; targets are created on the first resize()
+    OIT() : compositeShader("fullscreen.vert", "oit_composite.frag")
+    {
+        // the composite pass generates a fullscreen triangle from gl_VertexID, but core profile still needs a VAO bound
+        glGenVertexArrays(1, &emptyVAO);
+
+        setupComposite(compositeShader);
+        glUseProgram(0);
+    }
+
+    // reloads the composite shader when its files change
+    void watchShaders(ShaderHotReload& reload)
+    {
+        reload.watch(compositeShader, setupComposite);
+    }
+
+    OIT(const OIT&) = delete;
+    OIT& operator=(const OIT&) = delete;
+
+    ~OIT()
+    {
+        release();
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    // (re)creates the render targets when the framebuffer size changes
+    void resize(int w, int h)
+    {
+        if (w <= 0 || h <= 0 || (w == width && h == height))
+            return;
+        release();
+        width = w;
+        height = h;
+
+        sceneColor = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, "scene color");
+        accumTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8, "accumulation");
+        weightTexture = createTarget(GL_R16F, GL_RED, GL_HALF_FLOAT, 2, "revealage weight");
+        depthTexture = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4, "scene depth");
+
+        // opaque pass: scene color + depth
+        glGenFramebuffers(1, &sceneFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        checkFramebuffer("SCENE");
+
+        // translucent pass: accumulation + revealage, depth-tested against the opaque depth
+        glGenFramebuffers(1, &accumFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+        checkFramebuffer("ACCUM");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds the scene target for opaque geometry and clears it
+    void beginOpaque(float r, float g, float b, float a)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glViewport(0, 0, width, height);
+        glClearColor(r, g, b, a);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
+
+    // binds the accumulation targets; translucent draws must set oit_pass = 1 in the scene shader
+    void beginTransparent()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+        const float accumClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        const float weightClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, accumClear);
+        glClearBufferfv(GL_COLOR, 1, weightClear);
+
+        // depth test against opaque geometry, but translucent surfaces never occlude each other
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // resolves the translucent layers over the opaque image and copies the result to outputFBO
+    void composite()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        compositeShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, weightTexture);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    // sampler units, after building the shader and after every reload
+    static void setupComposite(Shader& shader)
+    {
+        shader.use();
+        shader.setInt("accumTexture", 0);
+        shader.setInt("weightTexture", 1);
+    }
+
+    Shader compositeShader;
+    unsigned int emptyVAO = 0;
+
+    // bytesPerTexel is only for the GpuMemory report
+    unsigned int createTarget(GLint internalFormat, GLenum format, GLenum type, int bytesPerTexel, const char* label)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        GpuMemory::track(GpuMemory::TEXTURE, texture, GpuMemory::textureBytes(width, height, 1, bytesPerTexel, false), "OIT", label);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void release()
+    {
+        if (sceneFBO == 0)
+            return;
+        glDeleteFramebuffers(1, &sceneFBO);
+        glDeleteFramebuffers(1, &accumFBO);
+        const unsigned int textures[4] = { sceneColor, accumTexture, weightTexture, depthTexture };
+        GpuMemory::deleteTextures(4, textures);
+        sceneFBO = accumFBO = 0;
+        sceneColor = accumTexture = weightTexture = depthTexture = 0;
+    }
+
+    void checkFramebuffer(const char* name)
+    {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            LOG_ERROR("ERROR::FRAMEBUFFER::{}::NOT_COMPLETE", name);
+    }
+};
+#endif
@@ -0,0 +1,690 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the texture maps of an OBJ material that Model samples, named after the Model sampler they feed
+struct ObjMaterial {
+    std::string name;
+    // map_Kd
+    std::string diffuse;
+    // map_Ks
+    std::string specular;
+    // map_Bump or bump, which Assimp reports as a height map and Model samples as texture_normal
+    std::string normal;
+    // map_Ka, Assimp's ambient map, texture_height in Model
+    std::string height;
+};
+
+// the faces of one object or group with one material, triangulated and indexed
+struct ObjMesh {
+    std::string name;
+    // into ObjModel::materials, -1 without one
+    int material = -1;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+struct ObjModel {
+    std::vector<ObjMesh> meshes;
+    std::vector<ObjMaterial> materials;
+};
+
+// Wavefront OBJ/MTL parser for Model, in place of the general Assimp import of every shipped model.
+// The file is memory-mapped and cut into chunks at line boundaries that are parsed in parallel,
+// numbers with std::from_chars. Corners are then resolved to global indices and every mesh is built
+// on its own, with a hash table that gives each distinct position/texcoord/normal triple one vertex.
+// The result matches what Model gets from Assimp with Triangulate, GenSmoothNormals, FlipUVs and
+// CalcTangentSpace, except that identical vertices are shared. load() fails rather than guess on
+// anything it cannot read, so Model can fall back to Assimp.
+class ObjLoader
+{
+public:
+    // bytes per parsing job; smaller files are parsed on the calling thread
+    static const size_t CHUNK_BYTES = 1 << 20;
+
+    static bool load(const std::string& path, ObjModel& model)
+    {
+        TRACE_SCOPE("parse obj");
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        const char* text = (const char*)file.data();
+        const size_t size = file.size();
+
+        // chunk boundaries, each moved on to the start of a line
+        const unsigned int chunkCount = (unsigned int)std::max((size_t)1, size / CHUNK_BYTES);
+        std::vector<size_t> bounds(chunkCount + 1, size);
+        bounds[0] = 0;
+        for (unsigned int i = 1; i < chunkCount; i++)
+        {
+            size_t at = std::max(bounds[i - 1], (size_t)((unsigned long long)size * i / chunkCount));
+            while (at < size && at > 0 && text[at - 1] != '\n')
+                at++;
+            bounds[i] = at;
+        }
+        JobSystem* jobs = chunkCount > 1 ? &parseJobs() : NULL;
+
+        std::vector<Chunk> chunks(chunkCount);
+        parallelFor(jobs, chunkCount, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                parseChunk(text + bounds[i], text + bounds[i + 1], chunks[i]);
+        });
+
+        // attributes of all chunks in file order, and where each chunk starts in them
+        Attributes attributes;
+        std::vector<Corner> bases(chunkCount);
+        size_t positions = 0, texcoords = 0, normals = 0;
+        for (unsigned int i = 0; i < chunkCount; i++)
+        {
+            if (chunks[i].bad)
+            {
+                LOG_WARN("OBJ::PARSE_FAILED {} at line {} of chunk {}", path, chunks[i].badLine, i);
+                return false;
+            }
+            bases[i] = { (int)positions, (int)texcoords, (int)normals, 0 };
+            positions += chunks[i].positions.size();
+            texcoords += chunks[i].texcoords.size();
+            normals += chunks[i].normals.size();
+        }
+        if (positions > INT_MAX || texcoords > INT_MAX || normals > INT_MAX)
+            return false;
+        attributes.positions.reserve(positions);
+        attributes.texcoords.reserve(texcoords);
+        attributes.normals.reserve(normals);
+        for (unsigned int i = 0; i < chunkCount; i++)
+        {
+            attributes.positions.insert(attributes.positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+            attributes.texcoords.insert(attributes.texcoords.end(), chunks[i].texcoords.begin(), chunks[i].texcoords.end());
+            attributes.normals.insert(attributes.normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+            std::vector<glm::vec3>().swap(chunks[i].positions);
+            std::vector<glm::vec2>().swap(chunks[i].texcoords);
+            std::vector<glm::vec3>().swap(chunks[i].normals);
+        }
+
+        // relative indices become absolute, everything is checked against the attribute counts
+        std::atomic<bool> outOfRange(false);
+        parallelFor(jobs, chunkCount, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (!resolve(chunks[i].corners, bases[i], attributes))
+                    outOfRange.store(true);
+            }
+        });
+        if (outOfRange.load())
+        {
+            LOG_WARN("OBJ::INDEX_OUT_OF_RANGE {}", path);
+            return false;
+        }
+
+        // faces grouped by object/group and material, in order of first appearance
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::map<std::string, int> materialIndex;
+        for (unsigned int i = 0; i < chunkCount; i++)
+            for (unsigned int j = 0; j < chunks[i].libraries.size(); j++)
+                loadMaterials(directory + chunks[i].libraries[j], model.materials, materialIndex);
+
+        std::vector<std::vector<FaceRange> > meshFaces;
+        std::map<std::pair<std::string, std::string>, unsigned int> meshOf;
+        std::string group, material;
+        for (unsigned int i = 0; i < chunkCount; i++)
+        {
+            const Chunk& chunk = chunks[i];
+            const unsigned int faceCount = (unsigned int)chunk.faceStarts.size() - 1;
+            unsigned int face = 0;
+            for (unsigned int e = 0; e <= chunk.events.size(); e++)
+            {
+                const unsigned int until = e < chunk.events.size() ? chunk.events[e].face : faceCount;
+                if (until > face)
+                {
+                    std::pair<std::string, std::string> key(group, material);
+                    std::map<std::pair<std::string, std::string>, unsigned int>::iterator found = meshOf.find(key);
+                    if (found == meshOf.end())
+                    {
+                        found = meshOf.insert(std::make_pair(key, (unsigned int)model.meshes.size())).first;
+                        ObjMesh mesh;
+                        mesh.name = group;
+                        std::map<std::string, int>::const_iterator named = materialIndex.find(material);
+                        mesh.material = named != materialIndex.end() ? named->second : -1;
+                        model.meshes.push_back(mesh);
+                        meshFaces.push_back(std::vector<FaceRange>());
+                    }
+                    FaceRange range = { i, face, until };
+                    meshFaces[found->second].push_back(range);
+                    face = until;
+                }
+                if (e < chunk.events.size())
+                    (chunk.events[e].group ? group : material) = chunk.events[e].name;
+            }
+        }
+        if (model.meshes.empty())
+        {
+            LOG_WARN("OBJ::NO_FACES {}", path);
+            return false;
+        }
+
+        parallelFor(jobs, (unsigned int)model.meshes.size(), 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++)
+                buildMesh(chunks, meshFaces[i], attributes, model.meshes[i]);
+        });
+        return true;
+    }
+
+private:
+    // one face corner; indices 0-based, MISSING where the face gives none. While a chunk is parsed,
+    // indices flagged in relative count from the chunk's first attribute of their kind
+    struct Corner {
+        int v;
+        int vt;
+        int vn;
+        unsigned char relative;
+    };
+
+    static const int MISSING = INT_MIN;
+
+    // a group ("o"/"g") or material ("usemtl") change before face number face of the chunk
+    struct Event {
+        unsigned int face;
+        bool group;
+        std::string name;
+    };
+
+    struct Chunk {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<Corner> corners;
+        // face i has corners [faceStarts[i], faceStarts[i + 1])
+        std::vector<unsigned int> faceStarts;
+        std::vector<Event> events;
+        std::vector<std::string> libraries;
+        bool bad = false;
+        unsigned int badLine = 0;
+    };
+
+    struct Attributes {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+    };
+
+    struct FaceRange {
+        unsigned int chunk;
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    // started on the first large file; its workers sleep while nothing is parsed
+    static JobSystem& parseJobs()
+    {
+        static JobSystem jobs;
+        return jobs;
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    static bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        p = skipSpace(p, end);
+        if (p < end && *p == '+')
+            p++;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec == std::errc::result_out_of_range)
+        {
+            // exported coordinates like -2.28e-49 underflow a float; they are read as doubles and
+            // rounded, and what a double cannot hold either becomes 0
+            double wide = 0.0;
+            result = std::from_chars(p, end, wide);
+            value = (float)wide;
+            if (result.ec == std::errc::result_out_of_range)
+                result.ec = std::errc();
+        }
+        if (result.ec != std::errc())
+            return false;
+        p = result.ptr;
+        return true;
+    }
+
+    static bool parseInt(const char*& p, const char* end, int& value)
+    {
+        if (p < end && *p == '+')
+            p++;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc())
+            return false;
+        p = result.ptr;
+        return true;
+    }
+
+    // the rest of the line without surrounding blanks
+    static std::string restOfLine(const char* p, const char* end)
+    {
+        p = skipSpace(p, end);
+        while (end > p && isSpace(end[-1]))
+            end--;
+        return std::string(p, end);
+    }
+
+    // 1-based or negative relative OBJ index to a Corner index, bit is the corner's relative flag
+    static bool toIndex(int index, size_t count, int& target, unsigned char& relative, unsigned char bit)
+    {
+        if (index > 0)
+            target = index - 1;
+        else if (index < 0)
+        {
+            target = (int)count + index;
+            relative |= bit;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    static void parseChunk(const char* p, const char* end, Chunk& chunk)
+    {
+        chunk.faceStarts.push_back(0);
+        unsigned int line = 0;
+        while (p < end && !chunk.bad)
+        {
+            const char* lineEnd = (const char*)std::memchr(p, '\n', end - p);
+            if (lineEnd == NULL)
+                lineEnd = end;
+            line++;
+            if (!parseLine(skipSpace(p, lineEnd), lineEnd, chunk))
+            {
+                chunk.bad = true;
+                chunk.badLine = line;
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    static bool parseLine(const char* p, const char* end, Chunk& chunk)
+    {
+        const char* word = p;
+        while (p < end && !isSpace(*p))
+            p++;
+        const size_t length = p - word;
+        if (length == 0 || word[0] == '#')
+            return true;
+
+        if (length == 1 && word[0] == 'v')
+        {
+            // an optional w or vertex color after xyz is ignored
+            glm::vec3 position;
+            if (!parseFloat(p, end, position.x) || !parseFloat(p, end, position.y) || !parseFloat(p, end, position.z))
+                return false;
+            chunk.positions.push_back(position);
+        }
+        else if (length == 2 && word[0] == 'v' && word[1] == 't')
+        {
+            glm::vec2 texcoord(0.0f);
+            if (!parseFloat(p, end, texcoord.x))
+                return false;
+            if (skipSpace(p, end) < end && !parseFloat(p, end, texcoord.y))
+                return false;
+            // the Assimp import flips V for OpenGL
+            texcoord.y = 1.0f - texcoord.y;
+            chunk.texcoords.push_back(texcoord);
+        }
+        else if (length == 2 && word[0] == 'v' && word[1] == 'n')
+        {
+            glm::vec3 normal;
+            if (!parseFloat(p, end, normal.x) || !parseFloat(p, end, normal.y) || !parseFloat(p, end, normal.z))
+                return false;
+            chunk.normals.push_back(normal);
+        }
+        else if (length == 1 && word[0] == 'f')
+        {
+            // v, v/vt, v//vn or v/vt/vn per corner
+            while ((p = skipSpace(p, end)) < end)
+            {
+                Corner corner = { MISSING, MISSING, MISSING, 0 };
+                int index;
+                if (!parseInt(p, end, index) || !toIndex(index, chunk.positions.size(), corner.v, corner.relative, 1))
+                    return false;
+                if (p < end && *p == '/')
+                {
+                    p++;
+                    if (p < end && *p != '/' && (!parseInt(p, end, index) || !toIndex(index, chunk.texcoords.size(), corner.vt, corner.relative, 2)))
+                        return false;
+                    if (p < end && *p == '/')
+                    {
+                        p++;
+                        if (!parseInt(p, end, index) || !toIndex(index, chunk.normals.size(), corner.vn, corner.relative, 4))
+                            return false;
+                    }
+                }
+                chunk.corners.push_back(corner);
+            }
+            // points and lines are not drawn
+            if (chunk.corners.size() - chunk.faceStarts.back() < 3)
+                chunk.corners.resize(chunk.faceStarts.back());
+            else
+                chunk.faceStarts.push_back((unsigned int)chunk.corners.size());
+        }
+        else if ((length == 1 && (word[0] == 'o' || word[0] == 'g')) || (length == 6 && std::memcmp(word, "usemtl", 6) == 0))
+        {
+            Event event = { (unsigned int)chunk.faceStarts.size() - 1, length == 1, restOfLine(p, end) };
+            chunk.events.push_back(event);
+        }
+        else if (length == 6 && std::memcmp(word, "mtllib", 6) == 0)
+            chunk.libraries.push_back(restOfLine(p, end));
+        // smoothing groups, lines, points and anything else do not change the meshes
+        return true;
+    }
+
+    // makes the chunk's corner indices absolute; false if any is out of range
+    static bool resolve(std::vector<Corner>& corners, const Corner& base, const Attributes& attributes)
+    {
+        for (unsigned int i = 0; i < corners.size(); i++)
+        {
+            Corner& corner = corners[i];
+            corner.v += (corner.relative & 1) ? base.v : 0;
+            if (corner.vt != MISSING)
+                corner.vt += (corner.relative & 2) ? base.vt : 0;
+            if (corner.vn != MISSING)
+                corner.vn += (corner.relative & 4) ? base.vn : 0;
+            corner.relative = 0;
+            if (corner.v < 0 || corner.v >= (int)attributes.positions.size() ||
+                (corner.vt != MISSING && (corner.vt < 0 || corner.vt >= (int)attributes.texcoords.size())) ||
+                (corner.vn != MISSING && (corner.vn < 0 || corner.vn >= (int)attributes.normals.size())))
+                return false;
+        }
+        return true;
+    }
+
+    // texture map file of a map_* statement: its last word, after any options
+    static std::string mapFile(const std::string& line)
+    {
+        size_t end = line.find_last_not_of(" \t\r");
+        if (end == std::string::npos)
+            return std::string();
+        size_t begin = line.find_last_of(" \t", end);
+        return line.substr(begin == std::string::npos ? 0 : begin + 1, end - (begin == std::string::npos ? 0 : begin + 1) + 1);
+    }
+
+    // a missing library leaves its materials unknown, as with Assimp the meshes then have none
+    static void loadMaterials(const std::string& path, std::vector<ObjMaterial>& materials, std::map<std::string, int>& index)
+    {
+        std::ifstream in(path.c_str());
+        if (!in)
+        {
+            LOG_WARN("OBJ::MATERIAL_LIBRARY_NOT_FOUND {}", path);
+            return;
+        }
+        ObjMaterial* current = NULL;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const char* p = skipSpace(line.data(), line.data() + line.size());
+            const char* end = line.data() + line.size();
+            const char* word = p;
+            while (p < end && !isSpace(*p))
+                p++;
+            const std::string keyword(word, p);
+            if (keyword == "newmtl")
+            {
+                ObjMaterial material;
+                material.name = restOfLine(p, end);
+                index[material.name] = (int)materials.size();
+                materials.push_back(material);
+                current = &materials.back();
+            }
+            else if (current == NULL)
+                continue;
+            else if (keyword == "map_Kd")
+                current->diffuse = mapFile(std::string(p, end));
+            else if (keyword == "map_Ks")
+                current->specular = mapFile(std::string(p, end));
+            else if (keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump")
+                current->normal = mapFile(std::string(p, end));
+            else if (keyword == "map_Ka")
+                current->height = mapFile(std::string(p, end));
+        }
+    }
+
+    // open addressing from a (position, texcoord, normal) triple to a vertex index
+    class VertexTable
+    {
+    public:
+        explicit VertexTable(size_t expected)
+        {
+            size_t capacity = 64;
+            while (capacity < expected * 2)
+                capacity *= 2;
+            grow(capacity);
+        }
+
+        // the vertex of key, or the one next, which the caller then appends, if the key is new
+        unsigned int find(const Corner& key, unsigned int next, bool& added)
+        {
+            if ((count + 1) * 2 > slots.size())
+                grow(slots.size() * 2);
+            size_t at = hash(key) & (slots.size() - 1);
+            while (slots[at].index != EMPTY)
+            {
+                const Slot& slot = slots[at];
+                if (slot.v == key.v && slot.vt == key.vt && slot.vn == key.vn)
+                {
+                    added = false;
+                    return slot.index;
+                }
+                at = (at + 1) & (slots.size() - 1);
+            }
+            Slot slot = { key.v, key.vt, key.vn, next };
+            slots[at] = slot;
+            count++;
+            added = true;
+            return next;
+        }
+
+    private:
+        static const unsigned int EMPTY = 0xFFFFFFFFu;
+
+        struct Slot {
+            int v;
+            int vt;
+            int vn;
+            unsigned int index;
+        };
+
+        std::vector<Slot> slots;
+        size_t count = 0;
+
+        static size_t hash(const Corner& key)
+        {
+            unsigned long long h = (unsigned int)key.v * 0x9E3779B97F4A7C15ull;
+            h ^= ((unsigned int)key.vt + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= ((unsigned int)key.vn + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+            return (size_t)(h ^ (h >> 29));
+        }
+
+        void grow(size_t capacity)
+        {
+            std::vector<Slot> old;
+            old.swap(slots);
+            Slot empty = { 0, 0, 0, EMPTY };
+            slots.assign(capacity, empty);
+            for (unsigned int i = 0; i < old.size(); i++)
+            {
+                if (old[i].index == EMPTY)
+                    continue;
+                size_t at = hash(Corner{ old[i].v, old[i].vt, old[i].vn, 0 }) & (capacity - 1);
+                while (slots[at].index != EMPTY)
+                    at = (at + 1) & (capacity - 1);
+                slots[at] = old[i];
+            }
+        }
+    };
+
+    // triangulates the mesh's faces as fans, shares identical vertices, then fills in what the Assimp
+    // post-processing would: smooth normals where the file has none, and tangents where it has UVs
+    static void buildMesh(const std::vector<Chunk>& chunks, const std::vector<FaceRange>& faces, const Attributes& attributes, ObjMesh& mesh)
+    {
+        TRACE_SCOPE("build obj mesh");
+        size_t corners = 0;
+        for (unsigned int r = 0; r < faces.size(); r++)
+        {
+            const Chunk& chunk = chunks[faces[r].chunk];
+            corners += chunk.faceStarts[faces[r].end] - chunk.faceStarts[faces[r].begin];
+        }
+        // most meshes share each vertex between several faces
+        VertexTable table(corners / 4);
+        std::vector<int> vertexPosition;
+        std::vector<bool> normalGiven;
+        bool texcoords = false;
+        bool missingNormals = false;
+        mesh.indices.reserve(corners * 3 / 2);
+
+        for (unsigned int r = 0; r < faces.size(); r++)
+        {
+            const Chunk& chunk = chunks[faces[r].chunk];
+            for (unsigned int f = faces[r].begin; f < faces[r].end; f++)
+            {
+                const unsigned int first = chunk.faceStarts[f];
+                const unsigned int count = chunk.faceStarts[f + 1] - first;
+                unsigned int face[3];
+                for (unsigned int k = 0; k < count; k++)
+                {
+                    const Corner& corner = chunk.corners[first + k];
+                    bool added;
+                    const unsigned int index = table.find(corner, (unsigned int)mesh.vertices.size(), added);
+                    if (added)
+                    {
+                        Vertex vertex = {};
+                        vertex.Position = attributes.positions[corner.v];
+                        if (corner.vt != MISSING)
+                        {
+                            vertex.TexCoords = attributes.texcoords[corner.vt];
+                            texcoords = true;
+                        }
+                        if (corner.vn != MISSING)
+                            vertex.Normal = attributes.normals[corner.vn];
+                        else
+                            missingNormals = true;
+                        mesh.vertices.push_back(vertex);
+                        vertexPosition.push_back(corner.v);
+                        normalGiven.push_back(corner.vn != MISSING);
+                    }
+                    // fan around the first corner
+                    if (k == 0)
+                        face[0] = index;
+                    else if (k == 1)
+                        face[1] = index;
+                    else
+                    {
+                        mesh.indices.push_back(face[0]);
+                        mesh.indices.push_back(face[1]);
+                        mesh.indices.push_back(index);
+                        face[1] = index;
+                    }
+                }
+            }
+        }
+
+        if (missingNormals)
+            smoothNormals(mesh, vertexPosition, normalGiven);
+        if (texcoords)
+            tangents(mesh);
+    }
+
+    // area-weighted face normals summed over every vertex at the same position, for the vertices whose
+    // corners had no normal
+    static void smoothNormals(ObjMesh& mesh, const std::vector<int>& vertexPosition, const std::vector<bool>& given)
+    {
+        // one sum per distinct position, found through the same table keyed by position alone
+        VertexTable table(mesh.vertices.size());
+        std::vector<unsigned int> sumOf(mesh.vertices.size());
+        std::vector<glm::vec3> sums;
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+        {
+            bool added;
+            const Corner key = { vertexPosition[i], MISSING, MISSING, 0 };
+            sumOf[i] = table.find(key, (unsigned int)sums.size(), added);
+            if (added)
+                sums.push_back(glm::vec3(0.0f));
+        }
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const unsigned int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+            const glm::vec3 normal = glm::cross(mesh.vertices[b].Position - mesh.vertices[a].Position, mesh.vertices[c].Position - mesh.vertices[a].Position);
+            sums[sumOf[a]] += normal;
+            sums[sumOf[b]] += normal;
+            sums[sumOf[c]] += normal;
+        }
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+        {
+            if (given[i])
+                continue;
+            const float length = glm::length(sums[sumOf[i]]);
+            mesh.vertices[i].Normal = length > 0.0f ? sums[sumOf[i]] / length : glm::vec3(0.0f);
+        }
+    }
+
+    // per-triangle tangent and bitangent from the UV gradients, summed per vertex; the tangent is made
+    // orthogonal to the normal
+    static void tangents(ObjMesh& mesh)
+    {
+        std::vector<glm::vec3> tangentSums(mesh.vertices.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> bitangentSums(mesh.vertices.size(), glm::vec3(0.0f));
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const unsigned int index[3] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+            const Vertex& a = mesh.vertices[index[0]];
+            const Vertex& b = mesh.vertices[index[1]];
+            const Vertex& c = mesh.vertices[index[2]];
+            const glm::vec3 edge1 = b.Position - a.Position;
+            const glm::vec3 edge2 = c.Position - a.Position;
+            const glm::vec2 uv1 = b.TexCoords - a.TexCoords;
+            const glm::vec2 uv2 = c.TexCoords - a.TexCoords;
+            const float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+            if (determinant == 0.0f)
+                continue;
+            const glm::vec3 tangent = (edge1 * uv2.y - edge2 * uv1.y) / determinant;
+            const glm::vec3 bitangent = (edge2 * uv1.x - edge1 * uv2.x) / determinant;
+            for (int k = 0; k < 3; k++)
+            {
+                tangentSums[index[k]] += tangent;
+                bitangentSums[index[k]] += bitangent;
+            }
+        }
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+        {
+            Vertex& vertex = mesh.vertices[i];
+            const glm::vec3 tangent = tangentSums[i] - vertex.Normal * glm::dot(vertex.Normal, tangentSums[i]);
+            const float tangentLength = glm::length(tangent);
+            const float bitangentLength = glm::length(bitangentSums[i]);
+            vertex.Tangent = tangentLength > 0.0f ? tangent / tangentLength : glm::vec3(0.0f);
+            vertex.Bitangent = bitangentLength > 0.0f ? bitangentSums[i] / bitangentLength : glm::vec3(0.0f);
+        }
+    }
+};
+#endif
@@ -0,0 +1,243 @@
+#ifndef PAGE_FILE_H
+#define PAGE_FILE_H
+
+#include <stb_image.h>
+
+#include "Log.h"
+#include "MappedFile.h"
+#include "TextureArray.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// An image cut into the fixed-size pages virtual texturing streams, with its whole mip chain.
+// Every page holds PAGE_SIZE x PAGE_SIZE RGBA8 texels plus a BORDER of its neighbours' texels on each
+// side, so bilinear filtering inside the physical page cache never reads a foreign page. The image is
+// resampled to a power-of-two number of pages per axis; each coarser mip halves the page count of
+// every axis that still has more than one page, the last mip is a single page. Pages are stored
+// mip by mip, row by row, all the same size, so a page's offset follows from its coordinates and the
+// file is read through a memory mapping without any index.
+class PageFile
+{
+public:
+    static const int PAGE_SIZE = 128;
+    static const int BORDER = 4;
+    static const int PADDED_SIZE = PAGE_SIZE + 2 * BORDER;
+    static const size_t PAGE_BYTES = (size_t)PADDED_SIZE * PADDED_SIZE * 4;
+    // page files are written here, relative to the working directory like the images they come from
+    static const char* directory() { return "texture_pages"; }
+
+    struct Header {
+        unsigned int magic;
+        unsigned int pageSize;
+        unsigned int border;
+        // pages of mip 0 per axis, powers of two
+        unsigned int pagesX;
+        unsigned int pagesY;
+        unsigned int mips;
+    };
+
+    Header header = {};
+
+    PageFile() {}
+
+    // maps the page file at path; returns false and logs if it is missing or not a page file
+    bool open(const std::string& path)
+    {
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(Header))
+        {
+            LOG_ERROR("ERROR::PAGE_FILE::INVALID {}", path);
+            return false;
+        }
+        header = *(const Header*)file.data();
+        if (!valid(header) || file.size() < sizeof(Header) + pageCount(header) * PAGE_BYTES)
+        {
+            LOG_ERROR("ERROR::PAGE_FILE::INVALID {}", path);
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    int pagesX(int mip) const
+    {
+        return std::max(1, (int)header.pagesX >> mip);
+    }
+
+    int pagesY(int mip) const
+    {
+        return std::max(1, (int)header.pagesY >> mip);
+    }
+
+    // the padded texels of a page; touching them may block on the disk
+    const unsigned char* page(int mip, int x, int y) const
+    {
+        size_t index = 0;
+        for (int level = 0; level < mip; level++)
+            index += (size_t)pagesX(level) * pagesY(level);
+        index += (size_t)y * pagesX(mip) + x;
+        return file.data() + sizeof(Header) + index * PAGE_BYTES;
+    }
+
+    // the page file for image, built first when it is missing or older than the image; returns an
+    // empty path if neither works. Needs the whole image in memory once, images too large for that
+    // have to be cut into the same format by an external tool
+    static std::string prepare(const std::string& image)
+    {
+        std::string name = image;
+        std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == ':' || c == '.'; }, '_');
+        const std::string path = std::string(directory()) + "/" + name + ".pages";
+
+        std::error_code error;
+        std::filesystem::file_time_type built = std::filesystem::last_write_time(path, error);
+        bool current = !error;
+        std::filesystem::file_time_type source = std::filesystem::last_write_time(image, error);
+        if (current && (error || built >= source) && headerMatches(path))
+            return path;
+        return build(image, path) ? path : std::string();
+    }
+
+private:
+    // "SSVT" at the start of every page file
+    static const unsigned int MAGIC = 0x54565353;
+
+    MappedFile file;
+
+    static bool valid(const Header& header)
+    {
+        return header.magic == MAGIC && header.pageSize == PAGE_SIZE && header.border == BORDER && header.pagesX > 0 &&
+            header.pagesY > 0 && header.mips > 0 && header.mips <= 16;
+    }
+
+    static size_t pageCount(const Header& header)
+    {
+        size_t count = 0;
+        for (unsigned int mip = 0; mip < header.mips; mip++)
+            count += (size_t)std::max(1u, header.pagesX >> mip) * std::max(1u, header.pagesY >> mip);
+        return count;
+    }
+
+    // page files from an older layout are rebuilt rather than rejected at open()
+    static bool headerMatches(const std::string& path)
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        Header header;
+        return in.read((char*)&header, sizeof(header)) && valid(header);
+    }
+
+    static unsigned int pagesFor(int texels)
+    {
+        unsigned int pages = 1;
+        while ((int)pages * PAGE_SIZE < texels)
+            pages *= 2;
+        return pages;
+    }
+
+    static bool build(const std::string& image, const std::string& path)
+    {
+        TRACE_SCOPE("build page file");
+        int w, h, n;
+        unsigned char* data = stbi_load(image.c_str(), &w, &h, &n, 4);
+        if (!data)
+        {
+            LOG_ERROR("ERROR::PAGE_FILE::IMAGE_NOT_LOADED {}", image);
+            return false;
+        }
+        Header header = { MAGIC, PAGE_SIZE, BORDER, pagesFor(w), pagesFor(h), 1 };
+        while (std::max(header.pagesX, header.pagesY) >> (header.mips - 1) > 1)
+            header.mips++;
+
+        int levelWidth = header.pagesX * PAGE_SIZE;
+        int levelHeight = header.pagesY * PAGE_SIZE;
+        std::vector<unsigned char> level((size_t)levelWidth * levelHeight * 4);
+        TextureArray::resample(data, w, h, level.data(), levelWidth, levelHeight);
+        stbi_image_free(data);
+
+        // written next to the final name and renamed over it, so a reader never sees half a file
+        std::error_code error;
+        std::filesystem::create_directories(directory(), error);
+        const std::string temporary = path + ".tmp";
+        std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        std::vector<unsigned char> page(PAGE_BYTES);
+        for (unsigned int mip = 0; mip < header.mips; mip++)
+        {
+            const int pagesX = std::max(1u, header.pagesX >> mip);
+            const int pagesY = std::max(1u, header.pagesY >> mip);
+            for (int y = 0; y < pagesY; y++)
+            {
+                for (int x = 0; x < pagesX; x++)
+                {
+                    cutPage(level, levelWidth, levelHeight, x, y, page.data());
+                    out.write((const char*)page.data(), PAGE_BYTES);
+                }
+            }
+            if (mip + 1 < header.mips)
+                halve(level, levelWidth, levelHeight, pagesX > 1, pagesY > 1);
+        }
+        out.close();
+        if (!out)
+        {
+            LOG_ERROR("ERROR::PAGE_FILE::FILE_NOT_SUCCESFULLY_WRITTEN {}", temporary);
+            return false;
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            LOG_ERROR("ERROR::PAGE_FILE::FILE_NOT_SUCCESFULLY_WRITTEN {} {}", path, error.message());
+            return false;
+        }
+        LOG_INFO("PAGE_FILE::BUILT {} {}x{} pages, {} mips", path, header.pagesX, header.pagesY, header.mips);
+        return true;
+    }
+
+    // copies page (x, y) of a mip level with its border, clamped at the level's edges
+    static void cutPage(const std::vector<unsigned char>& level, int width, int height, int x, int y, unsigned char* page)
+    {
+        for (int row = 0; row < PADDED_SIZE; row++)
+        {
+            const int sy = std::min(std::max(y * PAGE_SIZE - BORDER + row, 0), height - 1);
+            for (int column = 0; column < PADDED_SIZE; column++)
+            {
+                const int sx = std::min(std::max(x * PAGE_SIZE - BORDER + column, 0), width - 1);
+                const unsigned char* texel = &level[((size_t)sy * width + sx) * 4];
+                std::copy(texel, texel + 4, page + ((size_t)row * PADDED_SIZE + column) * 4);
+            }
+        }
+    }
+
+    // box-filters the level down to the next mip in place, along the axes that still have several pages
+    static void halve(std::vector<unsigned char>& level, int& width, int& height, bool halveX, bool halveY)
+    {
+        const int newWidth = halveX ? width / 2 : width;
+        const int newHeight = halveY ? height / 2 : height;
+        const int stepX = halveX ? 2 : 1;
+        const int stepY = halveY ? 2 : 1;
+        for (int y = 0; y < newHeight; y++)
+        {
+            for (int x = 0; x < newWidth; x++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = 0;
+                    for (int sy = 0; sy < stepY; sy++)
+                        for (int sx = 0; sx < stepX; sx++)
+                            sum += level[((size_t)(y * stepY + sy) * width + x * stepX + sx) * 4 + c];
+                    // in place is safe, the target texel never lies after its sources
+                    level[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)((sum + stepX * stepY / 2) / (stepX * stepY));
+                }
+            }
+        }
+        width = newWidth;
+        height = newHeight;
+        level.resize((size_t)width * height * 4);
+    }
+};
+#endif
@@ -0,0 +1,321 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+#include "imgui.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// CPU and GPU frame profiler.
+// Zones are opened and closed around each phase of the frame and may nest. Every zone records CPU
+// time with a steady clock and GPU time with a pair of GL timestamp queries; timestamps are used
+// rather than GL_TIME_ELAPSED because elapsed-time queries cannot nest. Queries are double-buffered:
+// a frame's results are read when its slot comes round again two frames later, and a query that
+// still is not available is dropped instead of waited on, so reading never stalls the pipeline
+// (unless blocking is set, as the benchmark does).
+class Profiler
+{
+public:
+    struct Zone {
+        const char* name;
+        int depth;
+        // milliseconds relative to the start of the frame
+        double cpuStart, cpuTime;
+        double gpuStart, gpuTime;
+        bool gpuValid;
+    };
+
+    struct FrameTiming {
+        double cpuTime;
+        double gpuTime;
+        bool gpuValid;
+    };
+
+    bool enabled = true;
+    // wait for GPU results instead of dropping late ones, for benchmarks that need every frame
+    bool blocking = false;
+    // when set, every collected frame's totals are appended to frameLog, oldest first
+    bool logFrames = false;
+    std::vector<FrameTiming> frameLog;
+    // zones of the most recent frame whose GPU results are in
+    std::vector<Zone> zones;
+    double frameCpuTime = 0.0;
+    double frameGpuTime = 0.0;
+
+    Profiler()
+    {
+        std::fill(cpuHistory, cpuHistory + HISTORY, 0.0f);
+        std::fill(gpuHistory, gpuHistory + HISTORY, 0.0f);
+        // room for any realistic frame up front, so toggling features on later does not allocate mid-frame
+        for (int i = 0; i < SLOTS; i++)
+        {
+            slots[i].zones.reserve(RESERVED_ZONES);
+            slots[i].queries.reserve(2 * RESERVED_ZONES + 2);
+        }
+        stack.reserve(RESERVED_ZONES);
+        zones.reserve(RESERVED_ZONES);
+    }
+
+    // starts recording a frame into the next slot, collecting what that slot held two frames ago
+    void beginFrame()
+    {
+        current = (current + 1) % SLOTS;
+        FrameSlot& slot = slots[current];
+        if (slot.recorded)
+            collect(slot);
+        slot.recorded = false;
+        recording = enabled;
+        if (!recording)
+            return;
+
+        slot.zones.clear();
+        slot.usedQueries = 0;
+        stack.clear();
+        frameStart = std::chrono::steady_clock::now();
+        slot.frameQuery = timestamp(slot);
+    }
+
+    void endFrame()
+    {
+        if (!recording)
+            return;
+        // close anything left open, e.g. by an early return
+        while (!stack.empty())
+            end();
+        FrameSlot& slot = slots[current];
+        slot.frameEndQuery = timestamp(slot);
+        slot.cpuTime = elapsed();
+        slot.recorded = true;
+        recording = false;
+    }
+
+    void begin(const char* name)
+    {
+        if (!recording)
+            return;
+        FrameSlot& slot = slots[current];
+        RecordedZone zone;
+        zone.name = name;
+        zone.depth = (int)stack.size();
+        zone.cpuStart = elapsed();
+        zone.cpuEnd = zone.cpuStart;
+        zone.beginQuery = timestamp(slot);
+        zone.endQuery = zone.beginQuery;
+        stack.push_back((unsigned int)slot.zones.size());
+        slot.zones.push_back(zone);
+    }
+
+    void end()
+    {
+        if (!recording || stack.empty())
+            return;
+        FrameSlot& slot = slots[current];
+        RecordedZone& zone = slot.zones[stack.back()];
+        stack.pop_back();
+        zone.cpuEnd = elapsed();
+        zone.endQuery = timestamp(slot);
+    }
+
+    // collects every frame still in flight, oldest first, waiting for its GPU results
+    void flush()
+    {
+        bool wasBlocking = blocking;
+        blocking = true;
+        for (int i = 1; i <= SLOTS; i++)
+        {
+            FrameSlot& slot = slots[(current + i) % SLOTS];
+            if (slot.recorded)
+                collect(slot);
+            slot.recorded = false;
+        }
+        blocking = wasBlocking;
+    }
+
+    // ImGui window with the frame time histograms and a CPU and a GPU flame graph of the last frame
+    void drawOverlay()
+    {
+        ImGui::Begin("Profiler");
+        ImGui::Checkbox("Enabled", &enabled);
+        ImGui::Text("CPU %.2f ms   GPU %.2f ms", frameCpuTime, frameGpuTime);
+
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "CPU max %.2f ms", *std::max_element(cpuHistory, cpuHistory + HISTORY));
+        ImGui::PlotHistogram("##cpu", cpuHistory, HISTORY, historyNext, overlay, 0.0f, 33.3f, ImVec2(0.0f, 60.0f));
+        snprintf(overlay, sizeof(overlay), "GPU max %.2f ms", *std::max_element(gpuHistory, gpuHistory + HISTORY));
+        ImGui::PlotHistogram("##gpu", gpuHistory, HISTORY, historyNext, overlay, 0.0f, 33.3f, ImVec2(0.0f, 60.0f));
+
+        // both flames share the frame's time scale so CPU and GPU bars line up
+        double span = std::max(std::max(frameCpuTime, frameGpuTime), 0.001);
+        ImGui::Text("CPU");
+        drawFlame(false, span);
+        ImGui::Text("GPU");
+        drawFlame(true, span);
+        ImGui::End();
+    }
+
+private:
+    static const int SLOTS = 2;
+    static const int HISTORY = 240;
+    static const int RESERVED_ZONES = 64;
+
+    struct RecordedZone {
+        const char* name;
+        int depth;
+        double cpuStart, cpuEnd;
+        unsigned int beginQuery, endQuery;
+    };
+
+    struct FrameSlot {
+        std::vector<RecordedZone> zones;
+        // timestamp queries, grown on demand and reused every time the slot comes round
+        std::vector<unsigned int> queries;
+        unsigned int usedQueries = 0;
+        unsigned int frameQuery = 0, frameEndQuery = 0;
+        double cpuTime = 0.0;
+        bool recorded = false;
+    };
+
+    FrameSlot slots[SLOTS];
+    int current = 0;
+    bool recording = false;
+    std::vector<unsigned int> stack;
+    std::chrono::steady_clock::time_point frameStart;
+
+    float cpuHistory[HISTORY];
+    float gpuHistory[HISTORY];
+    int historyNext = 0;
+
+    double elapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    }
+
+    // issues a timestamp query and returns its index in the slot
+    unsigned int timestamp(FrameSlot& slot)
+    {
+        if (slot.usedQueries == slot.queries.size())
+        {
+            unsigned int query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        glQueryCounter(slot.queries[slot.usedQueries], GL_TIMESTAMP);
+        return slot.usedQueries++;
+    }
+
+    bool available(const FrameSlot& slot, unsigned int index) const
+    {
+        GLint ready = 0;
+        glGetQueryObjectiv(slot.queries[index], GL_QUERY_RESULT_AVAILABLE, &ready);
+        return ready != 0;
+    }
+
+    double gpuMilliseconds(const FrameSlot& slot, unsigned int from, unsigned int to) const
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(slot.queries[from], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot.queries[to], GL_QUERY_RESULT, &end);
+        return end > begin ? (end - begin) / 1.0e6 : 0.0;
+    }
+
+    // turns a recorded slot into zone results; queries complete in order, so the frame's last
+    // timestamp being available means every earlier one is too
+    void collect(const FrameSlot& slot)
+    {
+        bool gpuReady = blocking || available(slot, slot.frameEndQuery);
+        if (!gpuReady)
+            LOG_EVERY(5.0, DEBUG, "PROFILER::GPU_TIMINGS_DROPPED results were not ready two frames later");
+        zones.resize(slot.zones.size());
+        for (unsigned int i = 0; i < slot.zones.size(); i++)
+        {
+            const RecordedZone& recorded = slot.zones[i];
+            Zone& zone = zones[i];
+            zone.name = recorded.name;
+            zone.depth = recorded.depth;
+            zone.cpuStart = recorded.cpuStart;
+            zone.cpuTime = recorded.cpuEnd - recorded.cpuStart;
+            zone.gpuValid = gpuReady;
+            zone.gpuStart = gpuReady ? gpuMilliseconds(slot, slot.frameQuery, recorded.beginQuery) : 0.0;
+            zone.gpuTime = gpuReady ? gpuMilliseconds(slot, recorded.beginQuery, recorded.endQuery) : 0.0;
+        }
+        frameCpuTime = slot.cpuTime;
+        if (gpuReady)
+            frameGpuTime = gpuMilliseconds(slot, slot.frameQuery, slot.frameEndQuery);
+
+        if (logFrames)
+        {
+            FrameTiming timing = { slot.cpuTime, gpuReady ? frameGpuTime : 0.0, gpuReady };
+            frameLog.push_back(timing);
+        }
+
+        cpuHistory[historyNext] = (float)frameCpuTime;
+        gpuHistory[historyNext] = (float)frameGpuTime;
+        historyNext = (historyNext + 1) % HISTORY;
+    }
+
+    void drawFlame(bool gpu, double span)
+    {
+        const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+        int depth = 1;
+        for (unsigned int i = 0; i < zones.size(); i++)
+            depth = std::max(depth, zones[i].depth + 1);
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+        ImVec2 size(width, rowHeight * depth);
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(30, 30, 30, 255));
+        drawList->PushClipRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), true);
+        for (unsigned int i = 0; i < zones.size(); i++)
+        {
+            const Zone& zone = zones[i];
+            if (gpu && !zone.gpuValid)
+                continue;
+            double start = gpu ? zone.gpuStart : zone.cpuStart;
+            double time = gpu ? zone.gpuTime : zone.cpuTime;
+            ImVec2 min(origin.x + (float)(start / span) * width, origin.y + zone.depth * rowHeight);
+            ImVec2 max(std::max(min.x + 1.0f, origin.x + (float)((start + time) / span) * width), min.y + rowHeight - 1.0f);
+            // stable color per zone name so a phase keeps its color between frames
+            unsigned int hash = (unsigned int)(size_t)zone.name * 2654435761u;
+            drawList->AddRectFilled(min, max, IM_COL32(80 + hash % 120, 80 + (hash >> 8) % 120, 80 + (hash >> 16) % 120, 255));
+            drawList->AddText(ImVec2(min.x + 2.0f, min.y + 1.0f), IM_COL32(255, 255, 255, 255), zone.name);
+            if (ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s: %.3f ms", zone.name, time);
+        }
+        drawList->PopClipRect();
+        ImGui::Dummy(size);
+    }
+};
+
+// opens a profiler zone for the rest of the enclosing block; a NULL profiler records nothing. The zone
+// is also recorded as a trace event, so every profiled phase shows up in the trace timeline
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler* profiler, const char* name) : profiler(profiler)
+#if SOLAR_SYSTEM_TRACING
+        , trace(name)
+#endif
+    {
+        if (profiler != NULL)
+            profiler->begin(name);
+    }
+
+    ~ProfileScope()
+    {
+        if (profiler != NULL)
+            profiler->end();
+    }
+
+private:
+    Profiler* profiler;
+#if SOLAR_SYSTEM_TRACING
+    TraceScope trace;
+#endif
+};
+#endif
@@ -0,0 +1,216 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include "Log.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// On-disk cache of linked programs.
+// Shader asks load() for a program before compiling anything; after a successful link it hands the
+// program to store(), which writes it with glGetProgramBinary to <directory>/<key>.bin. The key
+// hashes the sources of every stage (so any #define in them too) with the GL vendor, renderer and
+// version strings, so a driver update or an edited shader simply misses. A binary the driver
+// rejects is treated as a miss and overwritten by the fresh build. Needs GL 4.1 and a driver that
+// offers at least one binary format, otherwise every call misses. Safe to use from several threads
+// with their own contexts, e.g. the shader hot reload watcher.
+class ProgramCache
+{
+public:
+    // where binaries are kept, relative to the working directory like the shader sources; empty
+    // disables the cache. Set before the first shader is built
+    static std::string& directory()
+    {
+        static std::string path = "shader_cache";
+        return path;
+    }
+
+    // programs loaded from the cache and built from source since startup
+    static unsigned int hits()
+    {
+        return counters().hits.load();
+    }
+
+    static unsigned int misses()
+    {
+        return counters().misses.load();
+    }
+
+    // key of the program linked from count stages, with a current context
+    static unsigned long long key(const GLenum* types, const char* const* codes, int count)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        const GLenum strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (int i = 0; i < 3; i++)
+        {
+            const char* value = (const char*)glGetString(strings[i]);
+            hash = hashString(hash, value != NULL ? value : "");
+        }
+        for (int i = 0; i < count; i++)
+        {
+            hash = hashBytes(hash, (const char*)&types[i], sizeof(GLenum));
+            hash = hashString(hash, codes[i]);
+        }
+        return hash;
+    }
+
+    // the cached program for key, linked and ready to use, or 0 when there is none
+    static unsigned int load(unsigned long long key)
+    {
+        if (!supported())
+            return 0;
+        std::ifstream file(path(key).c_str(), std::ios::binary);
+        Header header;
+        std::vector<char> binary;
+        if (file && file.read((char*)&header, sizeof(header)) && header.magic == MAGIC && header.key == key)
+        {
+            // the header is trusted only as far as the file backs it, a truncated or corrupt file misses
+            const std::streamoff start = file.tellg();
+            file.seekg(0, std::ios::end);
+            const std::streamoff remaining = file.tellg() - start;
+            file.seekg(start);
+            if (header.length > 0 && header.length <= MAX_BINARY_BYTES && (std::streamoff)header.length == remaining)
+            {
+                binary.resize(header.length);
+                if (!file.read(binary.data(), header.length))
+                    binary.clear();
+            }
+        }
+        if (binary.empty())
+        {
+            counters().misses++;
+            return 0;
+        }
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            // usually a driver that changed without changing its version string
+            LOG_INFO("PROGRAM_CACHE::BINARY_REJECTED {}", path(key));
+            glDeleteProgram(program);
+            counters().misses++;
+            return 0;
+        }
+        counters().hits++;
+        return program;
+    }
+
+    // before linking a program that will be stored: lets the driver keep what it needs for the binary
+    static void prepare(unsigned int program)
+    {
+        if (supported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes a successfully linked program under key
+    static void store(unsigned long long key, unsigned int program)
+    {
+        if (!supported())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        // zeroed first, so the padding after magic is written as zeros rather than whatever was on the stack
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.key = key;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (unsigned int)written;
+
+        // written next to the final name and renamed over it, so a reader never sees half a file
+        std::error_code error;
+        std::filesystem::create_directories(directory(), error);
+        const std::string target = path(key);
+        // a name of its own per writer, the hot reload watcher may store under the same key
+        const std::string temporary = target + "." + std::to_string(counters().temporaries++) + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!file || !file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), written))
+            {
+                LOG_WARN("PROGRAM_CACHE::WRITE_FAILED {}", temporary);
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, target, error);
+        if (error)
+        {
+            LOG_WARN("PROGRAM_CACHE::WRITE_FAILED {} {}", target, error.message());
+            std::filesystem::remove(temporary, error);
+        }
+    }
+
+private:
+    // "SSPB" at the start of every file
+    static const unsigned int MAGIC = 0x42505353;
+    // larger binaries than any driver produces for these shaders are taken for corruption
+    static const unsigned int MAX_BINARY_BYTES = 64 << 20;
+
+    struct Header {
+        unsigned int magic;
+        unsigned long long key;
+        GLenum format;
+        unsigned int length;
+    };
+
+    struct Counters {
+        std::atomic<unsigned int> hits{ 0 };
+        std::atomic<unsigned int> misses{ 0 };
+        // numbers the temporary files of store()
+        std::atomic<unsigned int> temporaries{ 0 };
+    };
+
+    static Counters& counters()
+    {
+        static Counters instance;
+        return instance;
+    }
+
+    static bool supported()
+    {
+        if (directory().empty() || !GLAD_GL_VERSION_4_1)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static std::string path(unsigned long long key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", key);
+        return directory() + "/" + name;
+    }
+
+    // FNV-1a over a string with its terminator, so stages cannot run into each other
+    static unsigned long long hashString(unsigned long long hash, const char* text)
+    {
+        do
+        {
+            hash = (hash ^ (unsigned char)*text) * 1099511628211ull;
+        } while (*text++ != '\0');
+        return hash;
+    }
+
+    static unsigned long long hashBytes(unsigned long long hash, const char* bytes, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+};
+#endif
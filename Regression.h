@@ -0,0 +1,284 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <glad/glad.h>
+
+#include "Bench.h"
+#include "GLStats.h"
+#include "Log.h"
+#include "Profiler.h"
+#include "SolarSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Frame-time regression check.
+//   --regress [--baseline file] [--update-baseline] [--alpha A] [--threshold PERCENT]
+//             [--frames N] [--warmup N] [--width W] [--height H]
+// Runs every scenario headless, keeps the whole per-frame distribution of each metric and compares it
+// with the distribution stored in the baseline file. Each of p50, p95 and p99 is judged with a
+// one-sided Mann-Whitney U test: p50 over all frames, p95 and p99 over the slowest 10% and 2% of the
+// frames of each run, so a regression in the tail is not drowned out by an unchanged median. A
+// percentile regresses when the test is significant at alpha and the percentile is also more than
+// threshold percent slower, since with hundreds of frames even harmless shifts become significant.
+// Exits with 1 on a regression. Without a baseline file, or with --update-baseline, the run is
+// stored as the new baseline instead. Baselines only compare meaningfully on the same machine and
+// GL renderer; a renderer mismatch is reported.
+struct RegressionScenario {
+    const char* name;
+    int asteroids;
+    // false times scene.update alone, without rendering
+    bool render;
+};
+
+// today's interactive scene, then scaled versions of it with many more bodies
+inline const std::vector<RegressionScenario>& regressionScenarios()
+{
+    static const std::vector<RegressionScenario> scenarios = {
+        { "scene", 0, true },
+        { "asteroids-10k", 10000, true },
+        { "asteroids-50k", 50000, true },
+        { "simulation-50k", 50000, false },
+    };
+    return scenarios;
+}
+
+// per-frame milliseconds keyed by "<scenario> <metric>"
+typedef std::map<std::string, std::vector<double> > RegressionSamples;
+
+// one-sided Mann-Whitney U test of "current tends to be larger than baseline": normal approximation
+// with tie and continuity correction, returns the p-value
+inline double mannWhitneyGreater(const std::vector<double>& baseline, const std::vector<double>& current)
+{
+    const double n1 = (double)current.size();
+    const double n2 = (double)baseline.size();
+    if (n1 == 0.0 || n2 == 0.0)
+        return 1.0;
+
+    // pooled values, tagged with the sample they came from
+    std::vector<std::pair<double, int> > pooled;
+    for (unsigned int i = 0; i < current.size(); i++)
+        pooled.push_back(std::make_pair(current[i], 1));
+    for (unsigned int i = 0; i < baseline.size(); i++)
+        pooled.push_back(std::make_pair(baseline[i], 0));
+    std::sort(pooled.begin(), pooled.end());
+
+    // average ranks over ties
+    double currentRanks = 0.0;
+    double tieTerm = 0.0;
+    unsigned int i = 0;
+    while (i < pooled.size())
+    {
+        unsigned int j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first)
+            j++;
+        const double ties = j - i;
+        const double rank = (i + 1 + j) / 2.0;
+        for (unsigned int k = i; k < j; k++)
+        {
+            if (pooled[k].second == 1)
+                currentRanks += rank;
+        }
+        tieTerm += ties * ties * ties - ties;
+        i = j;
+    }
+
+    const double n = n1 + n2;
+    const double u = currentRanks - n1 * (n1 + 1.0) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+    if (variance <= 0.0)
+        return 1.0;
+    const double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// the slowest fraction of the values, at least minimum of them
+inline std::vector<double> slowestFrames(std::vector<double> values, double fraction, unsigned int minimum)
+{
+    std::sort(values.begin(), values.end());
+    unsigned int count = std::max(minimum, (unsigned int)std::ceil(values.size() * fraction));
+    count = std::min(count, (unsigned int)values.size());
+    return std::vector<double>(values.end() - count, values.end());
+}
+
+// reads a baseline file; returns false if it cannot be opened
+inline bool readRegressionSamples(const std::string& path, RegressionSamples& samples, std::string& renderer)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.compare(0, 11, "# renderer ") == 0)
+            renderer = line.substr(11);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string scenario, metric;
+        fields >> scenario >> metric;
+        std::vector<double>& values = samples[scenario + " " + metric];
+        double value;
+        while (fields >> value)
+            values.push_back(value);
+    }
+    return true;
+}
+
+inline bool writeRegressionSamples(const std::string& path, const RegressionSamples& samples, const std::string& renderer)
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+    {
+        LOG_ERROR("ERROR::REGRESS::FILE_NOT_SUCCESFULLY_WRITTEN {}", path);
+        return false;
+    }
+    out << "# solar system frame-time baseline: <scenario> <metric> <per-frame milliseconds>...\n";
+    out << "# renderer " << renderer << "\n";
+    for (RegressionSamples::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        out << it->first;
+        for (unsigned int i = 0; i < it->second.size(); i++)
+            out << " " << it->second[i];
+        out << "\n";
+    }
+    return true;
+}
+
+// compares every metric present in both runs; returns true if any percentile regressed
+inline bool compareRegressionSamples(const RegressionSamples& baseline, const RegressionSamples& current, const BenchOptions& options)
+{
+    struct Percentile {
+        const char* name;
+        double tail;
+    };
+    const Percentile percentiles[3] = { { "p50", 1.0 }, { "p95", 0.10 }, { "p99", 0.02 } };
+    // the normal approximation needs a handful of values on each side
+    const unsigned int minimumTail = 8;
+
+    bool regressed = false;
+    for (RegressionSamples::const_iterator it = current.begin(); it != current.end(); ++it)
+    {
+        RegressionSamples::const_iterator base = baseline.find(it->first);
+        if (base == baseline.end() || base->second.empty())
+        {
+            LOG_WARN("REGRESS::{} not in baseline", it->first);
+            continue;
+        }
+        BenchSummary before = summarize(base->second);
+        BenchSummary after = summarize(it->second);
+        for (int p = 0; p < 3; p++)
+        {
+            double was = p == 0 ? before.p50 : (p == 1 ? before.p95 : before.p99);
+            double now = p == 0 ? after.p50 : (p == 1 ? after.p95 : after.p99);
+            double change = was > 0.0 ? (now - was) / was * 100.0 : 0.0;
+            double pValue = mannWhitneyGreater(slowestFrames(base->second, percentiles[p].tail, minimumTail),
+                                               slowestFrames(it->second, percentiles[p].tail, minimumTail));
+            bool worse = pValue < options.alpha && change > options.threshold;
+            regressed = regressed || worse;
+            LOG_INFO("REGRESS::{} {} {:8.3f} -> {:8.3f} ms ({:+6.1f}%), p = {:.4f}{}", it->first, percentiles[p].name, was, now,
+                     change, pValue, worse ? "  REGRESSION" : "");
+        }
+    }
+    return regressed;
+}
+
+// runs every scenario into samples
+inline void runRegressionScenarios(const BenchOptions& options, RegressionSamples& samples)
+{
+    BenchTarget target;
+    target.create(options.width, options.height);
+
+    Profiler profiler;
+    profiler.blocking = true;
+    SolarSystem system(&profiler, 50);
+    system.oit.outputFBO = target.FBO;
+
+    const std::vector<RegressionScenario>& scenarios = regressionScenarios();
+    for (unsigned int s = 0; s < scenarios.size(); s++)
+    {
+        const RegressionScenario& scenario = scenarios[s];
+        LOG_INFO("REGRESS::SCENARIO {}", scenario.name);
+        system.scene.generateAsteroids(scenario.asteroids);
+        const std::string prefix = std::string(scenario.name) + " ";
+
+        if (scenario.render)
+        {
+            std::vector<GLFrameCounters> counters;
+            profiler.frameLog.clear();
+            renderBenchFrames(system, profiler, options, counters);
+            std::vector<double>& cpu = samples[prefix + "cpu_ms"];
+            std::vector<double>& gpu = samples[prefix + "gpu_ms"];
+            for (unsigned int i = 0; i < profiler.frameLog.size(); i++)
+            {
+                cpu.push_back(profiler.frameLog[i].cpuTime);
+                gpu.push_back(profiler.frameLog[i].gpuTime);
+            }
+        }
+        else
+        {
+            std::vector<double>& update = samples[prefix + "update_ms"];
+            const int total = options.warmup + options.frames;
+            for (int frame = 0; frame < total; frame++)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                system.scene.update(frame * options.atimeStep, 0.25f, 0.0f, 0.0f, 0.5f);
+                double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (frame >= options.warmup)
+                    update.push_back(time);
+            }
+        }
+    }
+    target.destroy();
+}
+
+// returns 1 on a regression, 0 when there is none or a baseline was written, -1 on errors
+inline int runRegression(const BenchOptions& options)
+{
+    HeadlessContext headless;
+    if (!headless.create())
+    {
+        LOG_ERROR("ERROR::REGRESS::CONTEXT_CREATION_FAILED");
+        return -1;
+    }
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+    LOG_INFO("REGRESS::CONTEXT {}", renderer);
+    GLStats::install();
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    RegressionSamples current;
+    runRegressionScenarios(options, current);
+    headless.destroy();
+
+    RegressionSamples baseline;
+    std::string baselineRenderer;
+    if (options.updateBaseline || !readRegressionSamples(options.baseline, baseline, baselineRenderer))
+    {
+        if (!writeRegressionSamples(options.baseline, current, renderer))
+            return -1;
+        LOG_INFO("REGRESS::BASELINE_WRITTEN {}", options.baseline);
+        return 0;
+    }
+    if (baselineRenderer != renderer)
+        LOG_WARN("REGRESS::WARNING baseline was recorded on {}", baselineRenderer);
+
+    bool regressed = compareRegressionSamples(baseline, current, options);
+    if (regressed)
+        LOG_ERROR("REGRESS::FAILED");
+    else
+        LOG_INFO("REGRESS::PASSED");
+    return regressed ? 1 : 0;
+}
+#endif
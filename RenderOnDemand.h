@@ -0,0 +1,257 @@
+#ifndef RENDER_ON_DEMAND_H
+#define RENDER_ON_DEMAND_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "GpuMemory.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+// Copy of the last scene image, so frames that only change the UI, or only need to be shown again,
+// can start from it instead of drawing every body again.
+class FrameCache
+{
+public:
+    FrameCache() {}
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    ~FrameCache()
+    {
+        release();
+    }
+
+    bool valid() const
+    {
+        return stored;
+    }
+
+    void invalidate()
+    {
+        stored = false;
+    }
+
+    // copies the window's back buffer into the cache
+    void store(int w, int h)
+    {
+        resize(w, h);
+        if (FBO == 0)
+            return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        stored = true;
+    }
+
+    // copies the cache into the window's back buffer; false if there is no image of this size
+    bool restore(int w, int h)
+    {
+        if (!stored || w != width || h != height)
+            return false;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+private:
+    unsigned int FBO = 0;
+    unsigned int color = 0;
+    int width = 0;
+    int height = 0;
+    bool stored = false;
+
+    void resize(int w, int h)
+    {
+        if (w <= 0 || h <= 0 || (w == width && h == height))
+            return;
+        release();
+        width = w;
+        height = h;
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        GpuMemory::track(GpuMemory::RENDERBUFFER, color, (unsigned long long)width * height * 4, "FrameCache", "last frame");
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void release()
+    {
+        if (FBO != 0)
+            glDeleteFramebuffers(1, &FBO);
+        if (color != 0)
+            GpuMemory::deleteRenderbuffers(1, &color);
+        FBO = 0;
+        color = 0;
+        width = 0;
+        height = 0;
+        stored = false;
+    }
+};
+
+// Render on demand: while nothing on screen can change, the loop sleeps in glfwWaitEventsTimeout
+// instead of drawing and swapping at full rate. Any input event wakes it and keeps it drawing for a
+// few frames, enough for ImGui to finish reacting (hover, release, popups); the loop itself decides
+// whether the scene changed and whether it is idle. The timeout picks up anything that does not
+// arrive as an event. Input is seen by chaining in front of the window's existing callbacks, so it
+// is constructed after ImGui has installed its own.
+class RenderOnDemand
+{
+public:
+    bool enabled = true;
+    // longest sleep while idle, in seconds
+    double timeout = 0.5;
+    // frames drawn after an input event
+    static const int SETTLE_FRAMES = 3;
+    // times the loop went to sleep
+    unsigned long long idleWaits = 0;
+
+    // one instance per window at a time
+    explicit RenderOnDemand(GLFWwindow* window) : window(window)
+    {
+        active() = this;
+        previous.key = glfwSetKeyCallback(window, onKey);
+        previous.character = glfwSetCharCallback(window, onChar);
+        previous.mouseButton = glfwSetMouseButtonCallback(window, onMouseButton);
+        previous.cursorPos = glfwSetCursorPosCallback(window, onCursorPos);
+        previous.cursorEnter = glfwSetCursorEnterCallback(window, onCursorEnter);
+        previous.scroll = glfwSetScrollCallback(window, onScroll);
+        previous.focus = glfwSetWindowFocusCallback(window, onFocus);
+        previous.framebufferSize = glfwSetFramebufferSizeCallback(window, onFramebufferSize);
+        previous.refresh = glfwSetWindowRefreshCallback(window, onRefresh);
+    }
+
+    RenderOnDemand(const RenderOnDemand&) = delete;
+    RenderOnDemand& operator=(const RenderOnDemand&) = delete;
+
+    ~RenderOnDemand()
+    {
+        glfwSetKeyCallback(window, previous.key);
+        glfwSetCharCallback(window, previous.character);
+        glfwSetMouseButtonCallback(window, previous.mouseButton);
+        glfwSetCursorPosCallback(window, previous.cursorPos);
+        glfwSetCursorEnterCallback(window, previous.cursorEnter);
+        glfwSetScrollCallback(window, previous.scroll);
+        glfwSetWindowFocusCallback(window, previous.focus);
+        glfwSetFramebufferSizeCallback(window, previous.framebufferSize);
+        glfwSetWindowRefreshCallback(window, previous.refresh);
+        active() = NULL;
+    }
+
+    // call after the swap: sleeps until the next event when idle, otherwise just polls
+    void waitEvents(bool idle)
+    {
+        settle = std::max(settle - 1, 0);
+        if (!enabled || !idle || settle > 0)
+        {
+            glfwPollEvents();
+            return;
+        }
+        TRACE_SCOPE("idle");
+        idleWaits++;
+        glfwWaitEventsTimeout(timeout);
+    }
+
+private:
+    struct Callbacks {
+        GLFWkeyfun key;
+        GLFWcharfun character;
+        GLFWmousebuttonfun mouseButton;
+        GLFWcursorposfun cursorPos;
+        GLFWcursorenterfun cursorEnter;
+        GLFWscrollfun scroll;
+        GLFWwindowfocusfun focus;
+        GLFWframebuffersizefun framebufferSize;
+        GLFWwindowrefreshfun refresh;
+    };
+
+    GLFWwindow* window;
+    Callbacks previous;
+    int settle = SETTLE_FRAMES;
+
+    static RenderOnDemand*& active()
+    {
+        static RenderOnDemand* instance = NULL;
+        return instance;
+    }
+
+    static void wake()
+    {
+        if (active() != NULL)
+            active()->settle = SETTLE_FRAMES;
+    }
+
+    static void onKey(GLFWwindow* window, int key, int scancode, int action, int mods)
+    {
+        wake();
+        if (active() != NULL && active()->previous.key)
+            active()->previous.key(window, key, scancode, action, mods);
+    }
+
+    static void onChar(GLFWwindow* window, unsigned int c)
+    {
+        wake();
+        if (active() != NULL && active()->previous.character)
+            active()->previous.character(window, c);
+    }
+
+    static void onMouseButton(GLFWwindow* window, int button, int action, int mods)
+    {
+        wake();
+        if (active() != NULL && active()->previous.mouseButton)
+            active()->previous.mouseButton(window, button, action, mods);
+    }
+
+    static void onCursorPos(GLFWwindow* window, double x, double y)
+    {
+        wake();
+        if (active() != NULL && active()->previous.cursorPos)
+            active()->previous.cursorPos(window, x, y);
+    }
+
+    static void onCursorEnter(GLFWwindow* window, int entered)
+    {
+        wake();
+        if (active() != NULL && active()->previous.cursorEnter)
+            active()->previous.cursorEnter(window, entered);
+    }
+
+    static void onScroll(GLFWwindow* window, double xoffset, double yoffset)
+    {
+        wake();
+        if (active() != NULL && active()->previous.scroll)
+            active()->previous.scroll(window, xoffset, yoffset);
+    }
+
+    static void onFocus(GLFWwindow* window, int focused)
+    {
+        wake();
+        if (active() != NULL && active()->previous.focus)
+            active()->previous.focus(window, focused);
+    }
+
+    static void onFramebufferSize(GLFWwindow* window, int width, int height)
+    {
+        wake();
+        if (active() != NULL && active()->previous.framebufferSize)
+            active()->previous.framebufferSize(window, width, height);
+    }
+
+    // the window system lost the window's contents and wants them drawn again
+    static void onRefresh(GLFWwindow* window)
+    {
+        wake();
+        if (active() != NULL && active()->previous.refresh)
+            active()->previous.refresh(window);
+    }
+};
+#endif
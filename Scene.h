@@ -0,0 +1,321 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// meshes a body can be drawn with
+enum BodyMesh {
+    MESH_PLANET,
+    MESH_SATTELITE,
+    MESH_ORBIT,
+    MESH_CONE,
+    MESH_COUNT
+};
+
+// body surface textures, in the order main.cpp loads them
+enum BodyTexture {
+    TEXTURE_NONE = -1,
+    TEXTURE_EARTH = 0,
+    TEXTURE_SUN = 1,
+    TEXTURE_PINK = 2
+};
+
+// a single drawable instance of the solar system, with its world transform already evaluated
+struct Body {
+    BodyMesh mesh;
+    glm::mat4 model;
+    glm::vec4 color;
+    int texture;
+    bool translucent;
+    // world-space bounding sphere: xyz center, w radius
+    glm::vec4 bounds;
+    // cleared by culling, bodies that are not visible are skipped at submission
+    bool visible;
+};
+
+// Evaluates the solar system's transform hierarchy into a flat list of bodies, so culling can run
+// on the whole frame before anything is submitted.
+class Scene
+{
+public:
+    std::vector<Body> bodies;
+    std::vector<glm::vec3> stars;
+    // radius of each mesh's bounding sphere around its local origin
+    float meshRadius[MESH_COUNT] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    // optional, times each group of bodies
+    Profiler* profiler = NULL;
+    // optional, spreads the asteroids and stars over its threads
+    JobSystem* jobs = NULL;
+
+    void generateStars(int count)
+    {
+        stars.clear();
+        for (int i = 0; i < count; i++) {
+            stars.push_back(glm::vec3((rand() % 50 + 1) - 20, (rand() % 50 + 1) - 25, (rand() % 100 + 1) - 90));
+        }
+    }
+
+    // scatters a belt of small bodies between the orbits of planet 3 and planet 4
+    void generateAsteroids(int count)
+    {
+        asteroids.clear();
+        for (int i = 0; i < count; i++) {
+            float radius = 72.0f + randomUnit() * 18.0f;
+            asteroids.radius.push_back(radius);
+            asteroids.phase.push_back(randomUnit() * 360.0f);
+            asteroids.height.push_back((randomUnit() - 0.5f) * 4.0f);
+            asteroids.size.push_back(0.1f + randomUnit() * 0.25f);
+            // inner asteroids go round faster, roughly following Kepler's third law from planet 3's speed
+            asteroids.speed.push_back(45.0f * std::pow(62.0f / radius, 1.5f));
+        }
+    }
+
+    unsigned int asteroidCount() const
+    {
+        return (unsigned int)asteroids.radius.size();
+    }
+
+    // rebuilds the body list for the given simulation time and view rotation
+    void update(float atime, float x_rotation, float y_rotation, float z_rotation, float transparency)
+    {
+        bodies.clear();
+        glm::mat4 system;
+        {
+            ProfileScope zone(profiler, "planets");
+            system = addPlanets(atime, x_rotation, y_rotation, z_rotation, transparency);
+        }
+        {
+            ProfileScope zone(profiler, "asteroids");
+            addAsteroids(atime, system);
+        }
+        {
+            ProfileScope zone(profiler, "stars");
+            addStars(atime);
+        }
+    }
+
+    // one planet's frame in the frame it orbits in: orbital rotation and position, size, axis tilt and
+    // axis rotation. Speeds are in degrees per 4 time units, the tilt in degrees
+    static glm::mat4 planetTransform(const glm::mat4& system, float atime, float orbitSpeed, float distance, float size, float tilt, float spin)
+    {
+        glm::mat4 planet = glm::rotate(system, atime / 4 * glm::radians(orbitSpeed), glm::vec3(0.0f, 1.0f, 0.0f));    //orbital rotation
+        planet = glm::translate(planet, glm::vec3(distance, 0.0f, 0.0f));                                           //orbital position
+        planet = glm::scale(planet, glm::vec3(size, size, size));                                                    //size
+        planet = glm::rotate(planet, glm::radians(tilt), glm::vec3(1.0f, 0.0f, 0.0f));                              //axis tilt
+        planet = glm::rotate(planet, atime / 4 * glm::radians(spin), glm::vec3(0.0f, 1.0f, 0.0f));                  //axis rotation
+        return planet;
+    }
+
+private:
+    // bodies evaluated per job
+    static const unsigned int TRANSFORM_GRAIN = 1024;
+
+    // the belt as one array per field, so a job range streams through just what it reads
+    struct AsteroidBelt {
+        std::vector<float> radius;
+        std::vector<float> phase;
+        std::vector<float> height;
+        std::vector<float> size;
+        // orbital speed in degrees per time unit
+        std::vector<float> speed;
+
+        void clear()
+        {
+            radius.clear();
+            phase.clear();
+            height.clear();
+            size.clear();
+            speed.clear();
+        }
+    };
+
+    AsteroidBelt asteroids;
+
+    static float randomUnit()
+    {
+        return (float)rand() / (float)RAND_MAX;
+    }
+
+    // the sun, planets, moons and their orbits; returns the frame the planets orbit in
+    glm::mat4 addPlanets(float atime, float x_rotation, float y_rotation, float z_rotation, float transparency)
+    {
+        glm::vec4 planet1_color = glm::vec4(1.0f, 1.0f, 1.0f, transparency);
+        glm::vec4 planet2_color = glm::vec4(1.0f, 0.0f, 1.0f, transparency);
+        glm::vec4 planet3_color = glm::vec4(0.0f, 1.0f, 1.0f, transparency);
+        glm::vec4 planet4_color = glm::vec4(1.0f, 0.0f, 0.0f, transparency);
+        glm::vec4 orbit_color = glm::vec4(0.8f, 0.8f, 1.0f, transparency);
+
+        // SUN
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
+        model = glm::rotate(model, x_rotation, glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::rotate(model, y_rotation, glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::rotate(model, z_rotation, glm::vec3(0.0f, 0.0f, 1.0f));
+        model = glm::rotate(model, atime / 4 * glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        add(MESH_PLANET, model, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f), TEXTURE_SUN);
+
+        // sun orbits
+        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+        add(MESH_ORBIT, model, planet1_color, TEXTURE_NONE, true);
+        model = glm::scale(model, 2.0f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, model, planet2_color, TEXTURE_PINK, true);
+        model = glm::scale(model, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, model, planet3_color, TEXTURE_EARTH, true);
+        model = glm::scale(model, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, model, planet4_color, TEXTURE_NONE, true);
+        const glm::mat4 system = model;
+
+        // PLANET 1
+        glm::mat4 planet = planetTransform(system, atime, 30.0f, 19.0f, 1.2f, 10.0f, 130.0f);
+        add(MESH_PLANET, planet, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), TEXTURE_NONE);
+
+        glm::mat4 orbit = glm::scale(planet, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+        orbit = glm::scale(orbit, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+
+        // moon 1
+        model = glm::rotate(orbit, atime / 8 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(100.0f, 0.0f, 0.0f));
+        model = glm::scale(model, 15.0f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_CONE, model, glm::vec4(0.8f, 0.8f, 1.0f, 1.0f), TEXTURE_NONE);
+
+        // moon 2
+        model = glm::rotate(orbit, atime / 8 * glm::radians(100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(60.0f, 0.0f, 0.0f));
+        model = glm::scale(model, 10.0f * glm::vec3(1.0f, 1.0f, 1.0f));
+        model = glm::rotate(model, glm::radians(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));                        //axis tilt
+        add(MESH_CONE, model, glm::vec4(0.8f, 0.6f, 1.0f, 1.0f), TEXTURE_NONE);
+
+        // PLANET 2
+        planet = planetTransform(system, atime, -60.0f, 38.0f, 0.9f, 10.0f, 130.0f);
+        add(MESH_SATTELITE, planet, glm::vec4(1.0f, 0.0f, 1.0f, 1.0f), TEXTURE_PINK);
+
+        // PLANET 3
+        planet = planetTransform(system, atime, 45.0f, 62.0f, 2.5f, 10.0f, 130.0f);
+        add(MESH_PLANET, planet, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), TEXTURE_EARTH);
+
+        orbit = glm::scale(planet, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+        orbit = glm::scale(orbit, 2.0f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+
+        // moon 1
+        model = glm::rotate(orbit, atime / 4 * glm::radians(40.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(100.0f, 0.0f, 0.0f));
+        model = glm::scale(model, 5.0f * glm::vec3(0.9f, 0.9f, 0.9f));
+        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 0.0f));                       //axis tilt
+        add(MESH_CONE, model, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), TEXTURE_NONE);
+
+        // moon 2
+        model = glm::rotate(planet, atime / 4 * glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(3.2f, 0.0f, 0.0f));
+        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+        add(MESH_SATTELITE, model, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), TEXTURE_NONE);
+
+        // PLANET 4
+        planet = planetTransform(system, atime, 25.0f, 100.0f, 2.5f, -10.0f, 130.0f);
+        add(MESH_PLANET, planet, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), TEXTURE_NONE);
+
+        orbit = glm::scale(planet, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+        orbit = glm::scale(orbit, 1.5f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+        orbit = glm::scale(orbit, 1.5f * glm::vec3(1.0f, 1.0f, 1.0f));
+        add(MESH_ORBIT, orbit, orbit_color, TEXTURE_NONE, true);
+
+        // moon 1
+        model = glm::rotate(orbit, atime / 4 * glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(8.2f, 0.0f, 0.0f));
+        model = glm::scale(model, 0.4f * glm::vec3(0.4f, 0.4f, 0.4f));
+        model = glm::rotate(model, glm::radians(2.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        add(MESH_SATTELITE, model, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), TEXTURE_NONE);
+
+        // moon 2
+        model = glm::rotate(planet, atime / 4 * glm::radians(20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(3.2f, 0.0f, 0.0f));
+        model = glm::scale(model, 0.5f * glm::vec3(0.5f, 0.5f, 0.5f));
+        model = glm::rotate(model, glm::radians(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        add(MESH_SATTELITE, model, glm::vec4(0.4f, 0.4f, 0.4f, 1.0f), TEXTURE_NONE);
+
+        // moon 3
+        model = glm::rotate(planet, atime / 4 * glm::radians(60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(4.2f, 0.0f, 0.0f));
+        model = glm::scale(model, 0.5f * glm::vec3(0.6f, 0.6f, 0.6f));
+        model = glm::rotate(model, glm::radians(-2.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        add(MESH_SATTELITE, model, glm::vec4(0.3f, 0.3f, 0.3f, 1.0f), TEXTURE_NONE);
+
+        // moon 4
+        model = glm::rotate(planet, atime / 8 * glm::radians(160.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(6.8f, 0.0f, 0.0f));
+        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+        model = glm::rotate(model, glm::radians(-1.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        add(MESH_SATTELITE, model, glm::vec4(0.5f, 0.2f, 0.5f, 1.0f), TEXTURE_NONE);
+
+        return system;
+    }
+
+    void addAsteroids(float atime, const glm::mat4& system)
+    {
+        const unsigned int first = (unsigned int)bodies.size();
+        bodies.resize(first + asteroidCount());
+        parallelFor(jobs, asteroidCount(), TRANSFORM_GRAIN, [&](unsigned int begin, unsigned int end) {
+            glm::mat4 model;
+            for (unsigned int i = begin; i < end; i++)
+            {
+                model = glm::rotate(system, glm::radians(asteroids.phase[i] + atime / 4 * asteroids.speed[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+                model = glm::translate(model, glm::vec3(asteroids.radius[i], asteroids.height[i], 0.0f));
+                model = glm::scale(model, asteroids.size[i] * glm::vec3(1.0f, 1.0f, 1.0f));
+                bodies[first + i] = makeBody(MESH_PLANET, model, glm::vec4(0.45f, 0.4f, 0.35f, 1.0f), TEXTURE_NONE);
+            }
+        });
+    }
+
+    // stars, twinkling between two sizes
+    void addStars(float atime)
+    {
+        const unsigned int first = (unsigned int)bodies.size();
+        bodies.resize(first + stars.size());
+        const float size = (int)(atime * 10) % 4 == 0 ? 0.3f : 0.5f;
+        parallelFor(jobs, (unsigned int)stars.size(), TRANSFORM_GRAIN, [&](unsigned int begin, unsigned int end) {
+            glm::mat4 model;
+            for (unsigned int i = begin; i < end; i++)
+            {
+                model = glm::translate(glm::mat4(1.0f), stars[i]);
+                model = glm::scale(model, size * glm::vec3(0.1f, 0.1f, 0.1f));
+                model = glm::rotate(model, glm::radians(20.0f * i), glm::vec3(1.0f, 0.3f, 0.5f));
+                bodies[first + i] = makeBody(MESH_CONE, model, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), TEXTURE_NONE);
+            }
+        });
+    }
+
+    void add(BodyMesh mesh, const glm::mat4& model, const glm::vec4& color, int texture, bool translucent = false)
+    {
+        bodies.push_back(makeBody(mesh, model, color, texture, translucent));
+    }
+
+    // only reads meshRadius, so jobs may call it concurrently
+    Body makeBody(BodyMesh mesh, const glm::mat4& model, const glm::vec4& color, int texture, bool translucent = false) const
+    {
+        Body body;
+        body.mesh = mesh;
+        body.model = model;
+        body.color = color;
+        body.texture = texture;
+        body.translucent = translucent;
+        // the largest axis scale bounds the mesh's sphere under rotation and non-uniform scale
+        float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        body.bounds = glm::vec4(glm::vec3(model[3]), meshRadius[mesh] * scale);
+        body.visible = true;
+        return body;
+    }
+};
+#endif
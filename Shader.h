@@ -4,6 +4,9 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "Log.h"
+#include "ProgramCache.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -14,157 +17,213 @@ class Shader
 public:
 	unsigned int ID;
 
+	// the files the program was built from, for reloading; empty where unused
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string geometryPath;
+	std::string computePath;
+
 	// constructor generates the shader on the fly
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) :
+		vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath != nullptr ? geometryPath : "")
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
 		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
+		readFile(vertexPath, vertexCode);
+		readFile(fragmentPath, fragmentCode);
+		// if geometry shader path is present, also load a geometry shader
+		if (geometryPath != nullptr)
+			readFile(geometryPath, geometryCode);
+		// 2. compile and link
+		std::string log;
+		ID = createProgram(vertexCode.c_str(), fragmentCode.c_str(), geometryPath != nullptr ? geometryCode.c_str() : nullptr, log);
+		if (!log.empty())
+			LOG_ERROR("{}", log.substr(0, log.size() - 1));
+	}
+	// constructor for a compute-only program
+	explicit Shader(const char* computePath) : computePath(computePath)
+	{
+		std::string computeCode;
+		readFile(computePath, computeCode);
+		std::string log;
+		ID = createComputeProgram(computeCode.c_str(), log);
+		if (!log.empty())
+			LOG_ERROR("{}", log.substr(0, log.size() - 1));
+	}
+
+	// reads a whole source file; logs and returns false if it cannot be read
+	static bool readFile(const char* path, std::string& code)
+	{
+		std::ifstream file;
 		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 		try
 		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
-			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
-			}
+			file.open(path);
+			std::stringstream stream;
+			stream << file.rdbuf();
+			file.close();
+			code = stream.str();
 		}
 		catch (std::ifstream::failure& e)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			LOG_ERROR("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ {}", path);
+			return false;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
+		return true;
+	}
+
+	// compiles and links a program from sources, geometryCode may be nullptr; any compile or link
+	// errors are appended to log, which stays empty on success
+	static unsigned int createProgram(const char* vertexCode, const char* fragmentCode, const char* geometryCode, std::string& log)
+	{
+		// a binary linked from the same sources by the same driver skips compiling altogether
+		const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+		const char* codes[3] = { vertexCode, fragmentCode, geometryCode };
+		unsigned long long key = ProgramCache::key(types, codes, geometryCode != nullptr ? 3 : 2);
+		unsigned int cached = ProgramCache::load(key);
+		if (cached != 0)
+			return cached;
+		size_t logStart = log.size();
+
+		unsigned int vertex = compile(GL_VERTEX_SHADER, vertexCode, "VERTEX", log);
+		unsigned int fragment = compile(GL_FRAGMENT_SHADER, fragmentCode, "FRAGMENT", log);
 		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
-		{
-			const char* gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
-		}
+		unsigned int geometry = 0;
+		if (geometryCode != nullptr)
+			geometry = compile(GL_GEOMETRY_SHADER, geometryCode, "GEOMETRY", log);
 		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		unsigned int program = glCreateProgram();
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		if (geometry != 0)
+			glAttachShader(program, geometry);
+		ProgramCache::prepare(program);
+		glLinkProgram(program);
+		checkCompileErrors(program, "PROGRAM", log);
+		if (log.size() == logStart)
+			ProgramCache::store(key, program);
 		// delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
+		if (geometry != 0)
 			glDeleteShader(geometry);
+		return program;
+	}
 
+	static unsigned int createComputeProgram(const char* computeCode, std::string& log)
+	{
+		const GLenum type = GL_COMPUTE_SHADER;
+		unsigned long long key = ProgramCache::key(&type, &computeCode, 1);
+		unsigned int cached = ProgramCache::load(key);
+		if (cached != 0)
+			return cached;
+		size_t logStart = log.size();
+
+		unsigned int compute = compile(GL_COMPUTE_SHADER, computeCode, "COMPUTE", log);
+		unsigned int program = glCreateProgram();
+		glAttachShader(program, compute);
+		ProgramCache::prepare(program);
+		glLinkProgram(program);
+		checkCompileErrors(program, "PROGRAM", log);
+		if (log.size() == logStart)
+			ProgramCache::store(key, program);
+		glDeleteShader(compute);
+		return program;
+	}
+
+	// takes over program, e.g. a reloaded build of the same sources, and deletes the old one
+	void replace(unsigned int program)
+	{
+		glDeleteProgram(ID);
+		ID = program;
 	}
+
 	// activate the shader
 	void use()
 	{
 		glUseProgram(ID);
 	}
 
-	void setBool(const std::string& name, bool value) const
+	void setBool(const char* name, bool value) const
+	{
+		glUniform1i(glGetUniformLocation(ID, name), (int)value);
+	}
+
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(glGetUniformLocation(ID, name), value);
 	}
 
-	void setInt(const std::string& name, int value) const
+	void setUint(const char* name, unsigned int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1ui(glGetUniformLocation(ID, name), value);
 	}
 
-	void setFloat(const std::string& name, float value) const
+	void setFloat(const char* name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(glGetUniformLocation(ID, name), value);
 	}
 
-	void setVec2(const std::string& name, const glm::vec2& value) const
+	void setVec2(const char* name, const glm::vec2& value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
 
-	void setVec2(const std::string& name, float x, float y) const
+	void setVec2(const char* name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(glGetUniformLocation(ID, name), x, y);
 	}
 
-	void setVec3(const std::string& name, const glm::vec3& value) const
+	void setVec3(const char* name, const glm::vec3& value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
 
-	void setVec3(const std::string& name, float x, float y, float z) const
+	void setVec3(const char* name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(glGetUniformLocation(ID, name), x, y, z);
 	}
 
-	void setVec4(const std::string& name, const glm::vec4& value) const
+	void setVec4(const char* name, const glm::vec4& value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]);
 	}
 
-	void setVec4(const std::string& name, float x, float y, float z, float w)
+	void setVec4(const char* name, float x, float y, float z, float w)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
 	}
 
-	void setMat2(const std::string& name, const glm::mat2& mat) const
+	void setMat2(const char* name, const glm::mat2& mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 
-	void setMat3(const std::string& name, const glm::mat3& mat) const
+	void setMat3(const char* name, const glm::mat3& mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 
-	void setMat4(const std::string& name, const glm::mat4& mat) const
+	void setMat4(const char* name, const glm::mat4& mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
-	// utility function for checking shader compilation/linking errors.
-	void checkCompileErrors(GLuint shader, std::string type)
+	static unsigned int compile(GLenum type, const char* code, const char* name, std::string& log)
+	{
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 1, &code, NULL);
+		glCompileShader(shader);
+		checkCompileErrors(shader, name, log);
+		return shader;
+	}
+
+	// utility function for checking shader compilation/linking errors, appended to log
+	static void checkCompileErrors(GLuint shader, std::string type, std::string& log)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -174,7 +233,7 @@ private:
 			if (!success)
 			{
 				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+				log += "ERROR::SHADER_COMPILATION_ERROR of type: " + type + "\n" + infoLog + "\n -- --------------------------------------------------- -- \n";
 			}
 		}
 		else
@@ -183,7 +242,7 @@ private:
 			if (!success)
 			{
 				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+				log += "ERROR::PROGRAM_LINKING_ERROR of type: " + type + "\n" + infoLog + "\n -- --------------------------------------------------- -- \n";
 			}
 		}
 	}
@@ -0,0 +1,292 @@
+#ifndef SHADER_HOT_RELOAD_H
+#define SHADER_HOT_RELOAD_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "Log.h"
+#include "MessageQueue.h"
+#include "Shader.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Rebuilds shaders while the program runs when their source files change.
+// A watcher thread notices the change (inotify on Linux, checking modification times elsewhere),
+// reads the sources and compiles and links them on a hidden window whose context shares objects with
+// the render context, so a rebuild never holds up a frame. Finished programs wait in a queue until
+// apply() swaps them in at the start of the next frame, then each shader's setup callback sets the
+// uniforms that are not set every frame. A program that fails to build is thrown away and the old one
+// stays in use, with the compile log reported. Without a shared context the build runs in apply().
+class ShaderHotReload
+{
+public:
+    // reloads swapped in and builds that failed, since start
+    unsigned int reloads = 0;
+    unsigned int failures = 0;
+    // compile log of the last build, empty when it succeeded
+    std::string lastLog;
+
+    // call on the main thread with share's context current
+    explicit ShaderHotReload(GLFWwindow* share)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        compileWindow = glfwCreateWindow(1, 1, "shader compiler", NULL, share);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        glfwMakeContextCurrent(share);
+        if (compileWindow == NULL)
+            LOG_WARN("SHADER_RELOAD::NO_SHARED_CONTEXT reloaded shaders build on the render thread");
+    }
+
+    ShaderHotReload(const ShaderHotReload&) = delete;
+    ShaderHotReload& operator=(const ShaderHotReload&) = delete;
+
+    // on the render thread
+    ~ShaderHotReload()
+    {
+        stopping.store(true);
+        if (thread.joinable())
+            thread.join();
+        // built but never swapped in
+        results.drain(received);
+        for (unsigned int i = 0; i < received.size(); i++)
+            if (received[i].program != 0)
+                glDeleteProgram(received[i].program);
+        if (compileWindow != NULL)
+            glfwDestroyWindow(compileWindow);
+    }
+
+    // reloads shader when one of its files changes; setup runs after every swap. Register everything
+    // before start(), the shader must outlive this object
+    void watch(Shader& shader, std::function<void(Shader&)> setup = std::function<void(Shader&)>())
+    {
+        Entry entry;
+        entry.shader = &shader;
+        entry.setup = setup;
+        const std::string* paths[4] = { &shader.vertexPath, &shader.fragmentPath, &shader.geometryPath, &shader.computePath };
+        for (int i = 0; i < 4; i++)
+        {
+            if (!paths[i]->empty())
+                entry.files.push_back(*paths[i]);
+        }
+        entry.stamps.resize(entry.files.size());
+        for (unsigned int i = 0; i < entry.files.size(); i++)
+            entry.stamps[i] = modified(entry.files[i]);
+        entries.push_back(entry);
+    }
+
+    void start()
+    {
+        thread = std::thread(&ShaderHotReload::run, this);
+    }
+
+    // render thread, at the start of a frame: swaps in every program built since the last call;
+    // returns how many were swapped
+    int apply()
+    {
+        results.drain(received);
+        int swapped = 0;
+        for (unsigned int i = 0; i < received.size(); i++)
+        {
+            Build& build = received[i];
+            Entry& entry = entries[build.entry];
+            if (!build.built)
+                build.program = compile(entry, build.log);
+            if (!build.log.empty())
+            {
+                LOG_ERROR("ERROR::SHADER_RELOAD::BUILD_FAILED {}, keeping the old program\n{}", entry.files[0], build.log);
+                glDeleteProgram(build.program);
+                lastLog = build.log;
+                failures++;
+                continue;
+            }
+            entry.shader->replace(build.program);
+            if (entry.setup)
+                entry.setup(*entry.shader);
+            LOG_INFO("SHADER_RELOAD::SWAPPED {}", entry.files[0]);
+            lastLog.clear();
+            reloads++;
+            swapped++;
+        }
+        return swapped;
+    }
+
+private:
+    struct Entry {
+        Shader* shader;
+        std::function<void(Shader&)> setup;
+        std::vector<std::string> files;
+        std::vector<std::filesystem::file_time_type> stamps;
+    };
+
+    // a finished build, or with built false a request for apply() to build
+    struct Build {
+        unsigned int entry;
+        bool built;
+        unsigned int program;
+        std::string log;
+    };
+
+    // read by the watcher only once it has started
+    std::vector<Entry> entries;
+    GLFWwindow* compileWindow = NULL;
+    MessageQueue<Build> results;
+    // render thread only
+    std::vector<Build> received;
+    std::atomic<bool> stopping{ false };
+    std::thread thread;
+
+    static std::filesystem::file_time_type modified(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type() : time;
+    }
+
+    // reads the entry's sources and builds them in the current context
+    static unsigned int compile(const Entry& entry, std::string& log)
+    {
+        const Shader& shader = *entry.shader;
+        std::string codes[3];
+        if (!shader.computePath.empty())
+        {
+            if (!Shader::readFile(shader.computePath.c_str(), codes[0]))
+                log = "could not read " + shader.computePath;
+            return log.empty() ? Shader::createComputeProgram(codes[0].c_str(), log) : 0;
+        }
+        bool read = Shader::readFile(shader.vertexPath.c_str(), codes[0]) && Shader::readFile(shader.fragmentPath.c_str(), codes[1]);
+        if (read && !shader.geometryPath.empty())
+            read = Shader::readFile(shader.geometryPath.c_str(), codes[2]);
+        if (!read)
+        {
+            log = "could not read the sources of " + shader.vertexPath;
+            return 0;
+        }
+        return Shader::createProgram(codes[0].c_str(), codes[1].c_str(), shader.geometryPath.empty() ? nullptr : codes[2].c_str(), log);
+    }
+
+    void run()
+    {
+        Trace::setThreadName("shader watcher");
+        if (compileWindow != NULL)
+            glfwMakeContextCurrent(compileWindow);
+
+#if defined(__linux__)
+        // one watch per directory; editors often save by writing a new file and renaming it over the
+        // old one, which a watch on the file itself would lose
+        int notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        std::set<std::string> directories;
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            for (unsigned int j = 0; j < entries[i].files.size(); j++)
+            {
+                std::string directory = std::filesystem::path(entries[i].files[j]).parent_path().string();
+                directories.insert(directory.empty() ? "." : directory);
+            }
+        }
+        for (std::set<std::string>::const_iterator it = directories.begin(); it != directories.end(); ++it)
+        {
+            if (notify >= 0 && inotify_add_watch(notify, it->c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+                LOG_WARN("SHADER_RELOAD::WATCH_FAILED {}", *it);
+        }
+        if (notify < 0)
+            LOG_WARN("SHADER_RELOAD::INOTIFY_UNAVAILABLE checking modification times instead");
+#endif
+
+        while (!stopping.load())
+        {
+#if defined(__linux__)
+            if (notify >= 0)
+            {
+                // wake up regularly to notice stopping
+                pollfd descriptor = { notify, POLLIN, 0 };
+                if (poll(&descriptor, 1, 100) <= 0)
+                    continue;
+                drainEvents(notify);
+            }
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+#else
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+#endif
+            // let a save that writes in several steps finish
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+#if defined(__linux__)
+            if (notify >= 0)
+                drainEvents(notify);
+#endif
+            rebuildChanged();
+        }
+
+#if defined(__linux__)
+        if (notify >= 0)
+            close(notify);
+#endif
+        if (compileWindow != NULL)
+            glfwMakeContextCurrent(NULL);
+    }
+
+#if defined(__linux__)
+    // the events only wake us up, modification times tell what changed
+    static void drainEvents(int notify)
+    {
+        char events[4096];
+        while (read(notify, events, sizeof(events)) > 0)
+        {
+        }
+    }
+#endif
+
+    void rebuildChanged()
+    {
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            bool changed = false;
+            bool missing = false;
+            for (unsigned int j = 0; j < entry.files.size(); j++)
+            {
+                std::filesystem::file_time_type stamp = modified(entry.files[j]);
+                // mid-save, replaced by rename; the next event brings it back
+                if (stamp == std::filesystem::file_time_type())
+                {
+                    missing = true;
+                    continue;
+                }
+                if (stamp != entry.stamps[j])
+                    changed = true;
+                entry.stamps[j] = stamp;
+            }
+            if (!changed || missing)
+                continue;
+
+            TRACE_SCOPE("shader rebuild");
+            Build build = { i, false, 0, std::string() };
+            if (compileWindow != NULL)
+            {
+                build.program = compile(entry, build.log);
+                // the render context may only use the program once it is complete here
+                glFinish();
+                build.built = true;
+            }
+            results.post(build);
+            // wake a render loop that is idle waiting for events
+            glfwPostEmptyEvent();
+        }
+    }
+};
+#endif
@@ -0,0 +1,149 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "MessageQueue.h"
+#include "Scene.h"
+#include "Trace.h"
+#include "TripleBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Runs the scene on its own thread at a fixed step, so a slow step never holds up presentation.
+// Every step advances the simulation time, evaluates the bodies and publishes them as a snapshot
+// through a triple buffer; the render thread draws whichever snapshot is newest. Settings changed in
+// the UI are posted as messages and applied at the start of the next step.
+class Simulation
+{
+public:
+    // everything the UI can change about the simulation
+    struct Settings {
+        float speed;
+        float x_rotation;
+        float y_rotation;
+        float z_rotation;
+        float transparency;
+        int asteroids;
+
+        bool operator!=(const Settings& other) const
+        {
+            return speed != other.speed || x_rotation != other.x_rotation || y_rotation != other.y_rotation ||
+                   z_rotation != other.z_rotation || transparency != other.transparency || asteroids != other.asteroids;
+        }
+    };
+
+    // one step's result
+    struct Snapshot {
+        std::vector<Body> bodies;
+        float atime = 0.0f;
+        // counts published snapshots, so a changed value means changed bodies
+        unsigned long long step = 0;
+    };
+
+    // copies scene, which keeps its meshRadius, stars and jobs, takes a first step and starts the thread
+    Simulation(const Scene& scene, const Settings& settings, float atime = 0.0f, double stepSeconds = 1.0 / 60.0) :
+        scene(scene), settings(settings), atime(atime), stepInterval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(stepSeconds)))
+    {
+        // the profiler belongs to the render thread
+        this->scene.profiler = NULL;
+        step();
+        thread = std::thread(&Simulation::run, this);
+    }
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    ~Simulation()
+    {
+        stopping.store(true);
+        thread.join();
+    }
+
+    // applied before the next step; callable from any thread
+    void post(const Settings& changed)
+    {
+        posted.fetch_add(1);
+        messages.post(changed);
+    }
+
+    // true once every posted change is in a published snapshot; checked before latest(), a true
+    // result means latest() returns a snapshot with all of them
+    bool caughtUp() const
+    {
+        return applied.load() == posted.load();
+    }
+
+    // newest published snapshot; it stays with the render thread until the next call, which may
+    // change the bodies' visible flags meanwhile
+    Snapshot& latest()
+    {
+        buffer.acquire();
+        return buffer.front();
+    }
+
+    // duration of the last step in milliseconds
+    double stepMilliseconds() const
+    {
+        return lastStep.load(std::memory_order_relaxed);
+    }
+
+private:
+    Scene scene;
+    Settings settings;
+    float atime;
+    std::chrono::steady_clock::duration stepInterval;
+    unsigned long long steps = 0;
+    TripleBuffer<Snapshot> buffer;
+    MessageQueue<Settings> messages;
+    std::vector<Settings> received;
+    std::atomic<unsigned long long> posted{ 0 };
+    std::atomic<unsigned long long> applied{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::atomic<double> lastStep{ 0.0 };
+    std::thread thread;
+
+    void run()
+    {
+        Trace::setThreadName("simulation");
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (!stopping.load())
+        {
+            // after a step slower than the interval, continue from now rather than racing to catch up
+            next = std::max(next + stepInterval, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next);
+            step();
+        }
+    }
+
+    void step()
+    {
+        TRACE_SCOPE("simulation step");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        messages.drain(received);
+        // paused with nothing new: the published snapshot is still current, and leaving it in place
+        // tells the render thread it has nothing to draw
+        if (received.empty() && settings.speed == 0.0f && steps > 0)
+            return;
+        for (unsigned int i = 0; i < received.size(); i++)
+            settings = received[i];
+        if ((unsigned int)settings.asteroids != scene.asteroidCount())
+            scene.generateAsteroids(settings.asteroids);
+
+        scene.update(atime, settings.x_rotation, settings.y_rotation, settings.z_rotation, settings.transparency);
+        Snapshot& snapshot = buffer.back();
+        // hand the bodies over; the next step rebuilds them in the storage this slot held before
+        std::swap(snapshot.bodies, scene.bodies);
+        snapshot.atime = atime;
+        snapshot.step = ++steps;
+        buffer.publish();
+        applied.fetch_add(received.size());
+
+        atime += settings.speed / 2;
+        lastStep.store(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    }
+};
+#endif
@@ -0,0 +1,241 @@
+#ifndef SOLAR_SYSTEM_H
+#define SOLAR_SYSTEM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "BodyRenderer.h"
+#include "Cone.h"
+#include "FrameArena.h"
+#include "HiZ.h"
+#include "JobSystem.h"
+#include "Model.h"
+#include "OIT.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "ShaderHotReload.h"
+#include "TextureArray.h"
+#include "VirtualTexture.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Everything SolarSystem is built from that can be prepared before it exists: models parsed,
+// textures decoded and page files built without GL, which any thread can do, plus the compiled body
+// shader. Startup fills it piece by piece from parallel tasks; load() does the same in order on the
+// calling thread.
+struct SolarSystemAssets {
+    Scene scene;
+    std::unique_ptr<Model> planet;
+    std::unique_ptr<Model> sattelite;
+    std::unique_ptr<Model> orbit;
+    std::unique_ptr<TextureArray> bodyTextures;
+    // virtual texture page file of every body texture layer, see PageFile::prepare
+    std::vector<std::string> pageFiles;
+    std::unique_ptr<Shader> shader;
+
+    static const char* planetPath() { return "../../res/models/sphere.obj"; }
+    static const char* sattelitePath() { return "../../res/models/Sattelite.obj"; }
+    static const char* orbitPath() { return "../../res/models/orbit.obj"; }
+
+    // body surface textures, layer order matches BodyTexture
+    static std::vector<std::string> bodyTexturePaths()
+    {
+        return { "../../res/models/Earth.jpg", "../../Textures/Sun.jpg", "../../Textures/pink.jpg" };
+    }
+
+    // needs a current GL context, for the shader
+    static SolarSystemAssets load()
+    {
+        SolarSystemAssets assets;
+        assets.scene.generateStars(250);
+        assets.planet.reset(new Model(planetPath(), false, false));
+        assets.sattelite.reset(new Model(sattelitePath(), false, false));
+        assets.orbit.reset(new Model(orbitPath(), false, false));
+        assets.bodyTextures.reset(new TextureArray(bodyTexturePaths(), 1024, 1024, false));
+        for (int layer = 0; layer < assets.bodyTextures->layers; layer++)
+            assets.bodyTextures->decodeLayer(layer);
+        std::vector<std::string> paths = bodyTexturePaths();
+        for (unsigned int layer = 0; layer < paths.size(); layer++)
+            assets.pageFiles.push_back(PageFile::prepare(paths[layer]));
+        assets.shader.reset(new Shader("shader.vert", "shader.frag"));
+        return assets;
+    }
+};
+
+// Owns the scene and every GL resource it is drawn with, and renders one frame of it. Shared by the
+// interactive window and the headless --bench loop so both measure the same work.
+class SolarSystem
+{
+public:
+    // first, so its workers outlive everything that hands them work
+    JobSystem jobs;
+    // transient data of the current frame; whoever drives the frames resets it after each one
+    FrameArena arena;
+    Scene scene;
+    Shader ourShader;
+    OIT oit;
+    HiZ hiz;
+    Model planet;
+    Model sattelite;
+    Model orbit;
+    BodyRenderer renderer;
+    TextureArray bodyTextures;
+    // the same surfaces streamed page by page; sampled instead of bodyTextures while enabled
+    VirtualTexture virtualTextures;
+    Shader feedbackShader;
+
+    // constructor, needs a current GL context; loads the models and textures
+    SolarSystem(Profiler* profiler, int sideDegree) : SolarSystem(profiler, sideDegree, SolarSystemAssets::load()) {}
+
+    // constructor from assets prepared beforehand, needs a current GL context; uploads the textures and
+    // creates the remaining GL resources. The models stay CPU-only, BodyRenderer copies their meshes
+    // into its own merged buffers and nothing draws them on their own
+    SolarSystem(Profiler* profiler, int sideDegree, SolarSystemAssets&& assets) :
+        scene(std::move(assets.scene)),
+        ourShader(*assets.shader),
+        planet(std::move(*assets.planet)),
+        sattelite(std::move(*assets.sattelite)),
+        orbit(std::move(*assets.orbit)),
+        // all body meshes in one buffer; the cone is regenerated from "Degrees step" so it gets a dynamic
+        // region large enough for the finest step of 1 degree
+        renderer(std::array<Model*, MESH_COUNT>{ { &planet, &sattelite, &orbit, NULL } }.data(), 2 * 3 * (360 + 1)),
+        bodyTextures(std::move(*assets.bodyTextures)),
+        virtualTextures(assets.pageFiles),
+        feedbackShader("shader.vert", "vt_feedback.frag"),
+        profiler(profiler)
+    {
+        bodyTextures.upload();
+        scene.meshRadius[MESH_PLANET] = planet.boundingRadius();
+        scene.meshRadius[MESH_SATTELITE] = sattelite.boundingRadius();
+        scene.meshRadius[MESH_ORBIT] = orbit.boundingRadius();
+        scene.meshRadius[MESH_CONE] = 2.0f;     // apex height of createCone, the base has radius 1
+        scene.profiler = profiler;
+        // transforms, occlusion culling and instance bucketing spread over every core
+        scene.jobs = &jobs;
+        hiz.jobs = &jobs;
+        renderer.jobs = &jobs;
+
+        updateCone(sideDegree);
+        renderer.gpuCulling = renderer.gpuCullingSupported;
+        renderer.profiler = profiler;
+
+        setupBodyShader(ourShader);
+    }
+
+    // reloads every shader a frame uses when its files change
+    void watchShaders(ShaderHotReload& reload)
+    {
+        reload.watch(ourShader, setupBodyShader);
+        reload.watch(feedbackShader);
+        oit.watchShaders(reload);
+        hiz.watchShaders(reload);
+        renderer.watchShaders(reload);
+    }
+
+    // culls and draws the bodies of the last scene.update() into a width x height target, which
+    // oit.outputFBO receives at the end
+    void render(const glm::mat4& view, const glm::mat4& projection, int width, int height, int sideDegree)
+    {
+        render(scene.bodies, view, projection, width, height, sideDegree);
+    }
+
+    // the same for bodies evaluated elsewhere, e.g. a Simulation snapshot; culling updates their
+    // visible flags
+    void render(std::vector<Body>& bodies, const glm::mat4& view, const glm::mat4& projection, int width, int height, int sideDegree)
+    {
+        {
+            ProfileScope zone(profiler, "culling");
+            // skip bodies hidden behind others in the previous frames' depth
+            hiz.cull(bodies);
+
+            // the cone only needs new vertices when its side step changes
+            if (coneSideDegree != sideDegree)
+                updateCone(sideDegree);
+            renderer.prepare(bodies, arena);
+            renderer.cull(projection * view);
+        }
+
+        // pages the last feedback asked for go in before drawing, then this frame's feedback is drawn
+        if (virtualTextures.active())
+        {
+            ProfileScope zone(profiler, "virtual texture feedback");
+            virtualTextures.update();
+            virtualTextures.resize(width, height);
+            virtualTextures.beginFeedback();
+            feedbackShader.use();
+            feedbackShader.setMat4("projection", projection);
+            feedbackShader.setMat4("view", view);
+            virtualTextures.setUniforms(feedbackShader, VirtualTexture::feedbackMipBias(), 1, 2);
+            renderer.draw(false);
+            virtualTextures.endFeedback();
+        }
+
+        // render opaque geometry into the OIT scene target
+        oit.resize(width, height);
+        hiz.resize(oit.width, oit.height);
+        oit.beginOpaque(0.05f, 0.05f, 0.05f, 1.0f);
+
+        // don't forget to enable shader before setting uniforms
+        ourShader.use();
+        ourShader.setInt("oit_pass", 0);
+        ourShader.setMat4("projection", projection);
+        ourShader.setMat4("view", view);
+        bodyTextures.bind(0);
+        ourShader.setBool("virtualTexturing", virtualTextures.active());
+        if (virtualTextures.active())
+            virtualTextures.setUniforms(ourShader, 0.0f, 1, 2);
+        {
+            ProfileScope zone(profiler, "opaque bodies");
+            renderer.draw(false);
+        }
+
+        // translucent orbits, accumulated in any order and composited over the opaque scene
+        {
+            ProfileScope zone(profiler, "translucent bodies");
+            oit.beginTransparent();
+            ourShader.setInt("oit_pass", 1);
+            renderer.draw(true);
+            ourShader.setInt("oit_pass", 0);
+        }
+        {
+            ProfileScope zone(profiler, "oit composite");
+            oit.composite();
+        }
+
+        // occlusion pyramid for the next frames
+        {
+            ProfileScope zone(profiler, "hi-z build");
+            hiz.build(oit.depthTexture, view, projection);
+        }
+        // everything reading this frame's instance regions is issued
+        renderer.endFrame();
+    }
+
+private:
+    Profiler* profiler;
+
+    // sampler units, after building the shader and after every reload
+    static void setupBodyShader(Shader& shader)
+    {
+        shader.use();
+        shader.setInt("bodyTextures", 0);
+        shader.setInt("pageTable", 1);
+        shader.setInt("physicalPages", 2);
+    }
+
+    int coneSideDegree = 0;
+
+    void updateCone(int sideDegree)
+    {
+        coneSideDegree = sideDegree;
+        ArenaVector<glm::vec3> coneVertices((ArenaAllocator<glm::vec3>(arena)));
+        createCone(coneVertices, sideDegree, 2.0f);
+        renderer.updateMesh(MESH_CONE, coneVertices, arena);
+    }
+};
+#endif
@@ -0,0 +1,185 @@
+#ifndef STARTUP_GRAPH_H
+#define STARTUP_GRAPH_H
+
+#include "Log.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Startup as a graph of tasks with dependencies.
+// A task starts once every task it depends on has finished. CPU-only tasks (parsing, decoding,
+// generation) run on a thread pool; tasks that touch the window or GL are marked MAIN and run on the
+// thread that calls run(), which is the one holding the context, in the order they become ready. A
+// task returns false when it failed: everything depending on it is skipped and run() returns false.
+// Every task is timed, and report() logs when each started and how long it took.
+class StartupGraph
+{
+public:
+    enum Thread { ANY, MAIN };
+
+    struct Task {
+        std::string name;
+        Thread thread;
+        std::function<bool()> work;
+        std::vector<int> dependents;
+        int waitingOn = 0;
+        // milliseconds since run() started
+        double start = 0.0;
+        double time = 0.0;
+        bool ok = false;
+        bool skipped = false;
+        std::string threadName;
+    };
+
+    // adds a task and returns its id for use in later dependency lists. The graph keeps the name and
+    // its trace events point into it, so the graph has to outlive any trace written
+    int add(const std::string& name, Thread thread, std::function<bool()> work, const std::vector<int>& dependencies = std::vector<int>())
+    {
+        Task task;
+        task.name = name;
+        task.thread = thread;
+        task.work = work;
+        task.waitingOn = (int)dependencies.size();
+        int id = (int)tasks.size();
+        for (unsigned int i = 0; i < dependencies.size(); i++)
+            tasks[dependencies[i]].dependents.push_back(id);
+        tasks.push_back(task);
+        return id;
+    }
+
+    // runs every task, ANY tasks on the pool and MAIN tasks on the calling thread; returns false if
+    // one failed
+    bool run(ThreadPool& pool)
+    {
+        TRACE_SCOPE("startup");
+        begin = std::chrono::steady_clock::now();
+        remaining = (int)tasks.size();
+        for (unsigned int i = 0; i < tasks.size(); i++)
+        {
+            if (tasks[i].waitingOn == 0)
+                schedule(pool, (int)i);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining > 0)
+        {
+            if (mainReady.empty())
+            {
+                wake.wait(lock);
+                continue;
+            }
+            int id = mainReady.front();
+            mainReady.pop_front();
+            lock.unlock();
+            execute(pool, id, "main");
+            lock.lock();
+        }
+        totalTime = elapsed();
+        return !failed;
+    }
+
+    // milliseconds from run() to the last task finishing
+    double totalMilliseconds() const
+    {
+        return totalTime;
+    }
+
+    // logs every task's start and duration, plus the total
+    void report() const
+    {
+        double busy = 0.0;
+        for (unsigned int i = 0; i < tasks.size(); i++)
+        {
+            const Task& task = tasks[i];
+            busy += task.time;
+            if (task.skipped)
+                LOG_INFO("STARTUP::TASK {:<24} skipped", task.name);
+            else
+                LOG_INFO("STARTUP::TASK {:<24} {:8.2f} ms at {:8.2f} ms on {}{}", task.name, task.time, task.start, task.threadName, task.ok ? "" : "  FAILED");
+        }
+        LOG_INFO("STARTUP::TOTAL {:.2f} ms wall, {:.2f} ms of tasks", totalTime, busy);
+    }
+
+    const std::vector<Task>& results() const
+    {
+        return tasks;
+    }
+
+private:
+    std::vector<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> mainReady;
+    int remaining = 0;
+    bool failed = false;
+    double totalTime = 0.0;
+    std::chrono::steady_clock::time_point begin;
+
+    double elapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // queues a task whose dependencies are done; call without the lock held
+    void schedule(ThreadPool& pool, int id)
+    {
+        if (tasks[id].thread == MAIN)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                mainReady.push_back(id);
+            }
+            wake.notify_all();
+        }
+        else
+        {
+            pool.submit([this, &pool, id]() { execute(pool, id, "pool"); });
+        }
+    }
+
+    void execute(ThreadPool& pool, int id, const char* threadName)
+    {
+        Task& task = tasks[id];
+        bool skip;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            skip = task.skipped;
+        }
+        if (!skip)
+        {
+            TraceScope trace(task.name.c_str());
+            task.threadName = threadName;
+            task.start = elapsed();
+            task.ok = task.work();
+            task.time = elapsed() - task.start;
+        }
+
+        std::vector<int> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!skip && !task.ok)
+                failed = true;
+            for (unsigned int i = 0; i < task.dependents.size(); i++)
+            {
+                Task& dependent = tasks[task.dependents[i]];
+                if (skip || !task.ok)
+                    dependent.skipped = true;
+                if (--dependent.waitingOn == 0)
+                    ready.push_back(task.dependents[i]);
+            }
+            remaining--;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < ready.size(); i++)
+            schedule(pool, ready[i]);
+    }
+};
+#endif
@@ -0,0 +1,182 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "GLStats.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Buffer for data the CPU rewrites every frame, split into one region per frame in flight.
+// With GL 4.4 buffer storage the buffer is mapped once, persistently and coherently: each frame
+// writes straight into its own region while the GPU may still be reading the regions of the frames
+// before, and a fence per region makes the CPU wait only if it laps the GPU. Without it every frame
+// orphans the buffer with glBufferData and uploads from a CPU copy, which lets the driver hand out
+// fresh storage instead of syncing. Per frame: begin() and write, end() before the commands that read
+// the region, fence() after the last of them.
+class StreamBuffer
+{
+public:
+    // times begin() had to wait for the GPU to release a region
+    unsigned long long stalls = 0;
+
+    // owner and label name it in GpuMemory; alignment is the offset alignment the regions get bound
+    // with, e.g. for glBindBufferRange
+    StreamBuffer(GLenum target, const std::string& owner, const std::string& label, int frames = 3, size_t alignment = 256) :
+        target(target), owner(owner), label(label), frames(frames), alignment(std::max<size_t>(alignment, 16)), fences(frames, (GLsync)0)
+    {
+#if defined(GL_VERSION_4_4)
+        persistent = GLAD_GL_VERSION_4_4 != 0;
+#endif
+        glGenBuffers(1, &ID);
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer()
+    {
+        release();
+        GpuMemory::deleteBuffers(1, &ID);
+    }
+
+    bool isPersistent() const
+    {
+        return persistent;
+    }
+
+    unsigned int id() const
+    {
+        return ID;
+    }
+
+    // byte offset of the current frame's region in the buffer
+    size_t offset() const
+    {
+        return persistent ? frame * capacity : 0;
+    }
+
+    // returns where to write this frame's bytes, valid until end()
+    void* begin(size_t bytes)
+    {
+        if (bytes > capacity)
+            grow(bytes);
+        if (!persistent)
+        {
+            staging.resize(std::max<size_t>(bytes, 1));
+            return &staging[0];
+        }
+        wait(frame);
+        return mapped + offset();
+    }
+
+    // makes the bytes written since begin() visible to the GPU
+    void end(size_t bytes)
+    {
+        // the persistent mapping is coherent, nothing to upload; the bytes still count as this frame's
+        // upload, the glBufferSubData below counts itself
+        if (persistent)
+        {
+            GLStats::addUpload(bytes);
+            return;
+        }
+        // orphan, then upload into the fresh storage
+        glBindBuffer(target, ID);
+        glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(target, 0, bytes, &staging[0]);
+    }
+
+    // marks the current region as in use by the commands issued so far and moves to the next one
+    void fence()
+    {
+        if (!persistent)
+            return;
+#if defined(GL_VERSION_4_4)
+        if (fences[frame])
+            glDeleteSync(fences[frame]);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+        frame = (frame + 1) % frames;
+    }
+
+private:
+    unsigned int ID = 0;
+    GLenum target;
+    std::string owner;
+    std::string label;
+    int frames;
+    size_t alignment;
+    bool persistent = false;
+    // bytes per region
+    size_t capacity = 0;
+    int frame = 0;
+    unsigned char* mapped = NULL;
+    std::vector<GLsync> fences;
+    std::vector<unsigned char> staging;
+
+    void wait(int region)
+    {
+        if (!fences[region])
+            return;
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            do
+                status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+
+    // waits for every region and drops the storage
+    void release()
+    {
+        for (int region = 0; region < frames; region++)
+            wait(region);
+        if (mapped)
+        {
+            glBindBuffer(target, ID);
+            glUnmapBuffer(target);
+            mapped = NULL;
+        }
+    }
+
+    void grow(size_t bytes)
+    {
+        capacity = std::max(bytes, capacity * 2);
+        capacity = (capacity + alignment - 1) / alignment * alignment;
+        if (!persistent)
+        {
+            GpuMemory::track(GpuMemory::BUFFER, ID, capacity, owner, label);
+            return;
+        }
+#if defined(GL_VERSION_4_4)
+        // buffer storage is immutable, so growing means a new buffer
+        release();
+        GpuMemory::deleteBuffers(1, &ID);
+        glGenBuffers(1, &ID);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBindBuffer(target, ID);
+        glBufferStorage(target, frames * capacity, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, frames * capacity, flags);
+        frame = 0;
+        if (mapped == NULL)
+        {
+            // out of memory for an immutable buffer of this size; orphaning may still get by
+            persistent = false;
+            GpuMemory::deleteBuffers(1, &ID);
+            glGenBuffers(1, &ID);
+            GpuMemory::track(GpuMemory::BUFFER, ID, capacity, owner, label);
+            return;
+        }
+        GpuMemory::track(GpuMemory::BUFFER, ID, frames * capacity, owner, label + " (" + std::to_string(frames) + " frames)");
+#endif
+    }
+};
+#endif
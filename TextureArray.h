@@ -0,0 +1,136 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include "GpuMemory.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Packs several images into one GL_TEXTURE_2D_ARRAY, one layer per image, so bodies with different
+// surface textures can be drawn by the same instanced call. Every image is resized to a common
+// resolution at load; sphere UVs are normalized so the aspect change does not distort the mapping.
+class TextureArray
+{
+public:
+    unsigned int ID = 0;
+    int width;
+    int height;
+    int layers = 0;
+
+    // constructor, loads the images in order, layer i holds paths[i]. With upload false only the pixel
+    // staging is allocated: decodeLayer() then fills the layers, from any threads, and upload() creates
+    // the texture on the GL thread
+    TextureArray(const std::vector<std::string>& paths, int width = 1024, int height = 1024, bool upload = true) :
+        width(width), height(height), paths(paths)
+    {
+        layers = (int)paths.size();
+        pixels.resize((size_t)width * height * 4 * layers);
+        if (!upload)
+            return;
+
+        TRACE_SCOPE("load texture array");
+        for (int layer = 0; layer < layers; layer++)
+            decodeLayer(layer);
+        this->upload();
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    TextureArray(TextureArray&& other) noexcept : ID(other.ID), width(other.width), height(other.height), layers(other.layers),
+        paths(std::move(other.paths)), pixels(std::move(other.pixels))
+    {
+        other.ID = 0;
+    }
+
+    ~TextureArray()
+    {
+        GpuMemory::deleteTextures(1, &ID);
+    }
+
+    // decodes one image into its layer; different layers may be decoded concurrently
+    void decodeLayer(int layer)
+    {
+        loadLayer(paths[layer], &pixels[(size_t)width * height * 4 * layer]);
+    }
+
+    // creates the texture from the decoded layers and frees the staging pixels; needs a current context
+    void upload()
+    {
+        glGenTextures(1, &ID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        std::string owner;
+        for (int layer = 0; layer < layers; layer++)
+            owner += (layer > 0 ? ", " : "") + paths[layer];
+        GpuMemory::track(GpuMemory::TEXTURE, ID, GpuMemory::textureBytes(width, height, layers, 4, true), owner, "texture array");
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        std::vector<unsigned char>().swap(pixels);
+    }
+
+    // binds the array to the given texture unit
+    void bind(unsigned int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+    }
+
+private:
+    std::vector<std::string> paths;
+    // decoded layers until upload()
+    std::vector<unsigned char> pixels;
+
+    // decodes one image as RGBA and bilinearly resamples it into the layer
+    void loadLayer(const std::string& path, unsigned char* layer)
+    {
+        TRACE_SCOPE("load texture layer");
+        int w, h, n;
+        unsigned char* data = stbi_load(path.c_str(), &w, &h, &n, 4);
+        if (!data)
+        {
+            LOG_ERROR("Texture failed to load at path: {}", path);
+            std::fill(layer, layer + (size_t)width * height * 4, (unsigned char)255);
+            return;
+        }
+        resample(data, w, h, layer, width, height);
+        stbi_image_free(data);
+    }
+
+public:
+    // bilinear resize of an RGBA image, also used to cut virtual texture pages
+    static void resample(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight)
+    {
+        for (int y = 0; y < dstHeight; y++)
+        {
+            float sy = std::max(0.0f, (y + 0.5f) * srcHeight / dstHeight - 0.5f);
+            int y0 = std::min((int)sy, srcHeight - 1);
+            int y1 = std::min(y0 + 1, srcHeight - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < dstWidth; x++)
+            {
+                float sx = std::max(0.0f, (x + 0.5f) * srcWidth / dstWidth - 0.5f);
+                int x0 = std::min((int)sx, srcWidth - 1);
+                int x1 = std::min(x0 + 1, srcWidth - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++)
+                {
+                    float top = src[(y0 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[(y0 * srcWidth + x1) * 4 + c] * fx;
+                    float bottom = src[(y1 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[(y1 * srcWidth + x1) * 4 + c] * fx;
+                    dst[((size_t)y * dstWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+    }
+};
+#endif
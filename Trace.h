@@ -0,0 +1,205 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Log.h"
+
+// Chrome trace-event recorder (chrome://tracing, ui.perfetto.dev).
+// TRACE_SCOPE(name) records a complete event for the enclosing block into a ring buffer owned by the
+// calling thread, so recording takes no lock and threads never contend. Trace::write() collects every
+// thread's buffer into a trace-event JSON file on demand; a ring that wrapped keeps its newest events.
+// A thread's ring is only allocated by its first recorded event, so threads are free to name
+// themselves while tracing is off. Build with SOLAR_SYSTEM_TRACING=0 to compile every scope and thread
+// name out; otherwise a disabled trace costs one relaxed atomic load per scope. Names must be string
+// literals or otherwise outlive the trace.
+#ifndef SOLAR_SYSTEM_TRACING
+#define SOLAR_SYSTEM_TRACING 1
+#endif
+
+class Trace
+{
+public:
+    // events kept per thread
+    static const unsigned int CAPACITY = 1 << 16;
+
+    static bool enabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled)
+    {
+        enabledFlag().store(enabled, std::memory_order_relaxed);
+    }
+
+    // name shown for the calling thread's track; only the name is stored, not the ring
+    static void setThreadName(const std::string& name)
+    {
+#if SOLAR_SYSTEM_TRACING
+        Buffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer.name = name;
+#else
+        (void)name;
+#endif
+    }
+
+    // microseconds since the first use of the trace
+    static uint64_t now()
+    {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static void record(const char* name, uint64_t start, uint64_t end)
+    {
+        Buffer& buffer = threadBuffer();
+        // only the owner allocates, under the lock write() reads the rings with
+        if (buffer.events.empty())
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            buffer.events.resize(CAPACITY);
+        }
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        Event& event = buffer.events[head % CAPACITY];
+        event.name = name;
+        event.start = start;
+        event.duration = end - start;
+        // publishes the event to write()
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // writes every thread's events as Chrome trace-event JSON; returns false if the file cannot be opened
+    static bool write(const std::string& path)
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+        {
+            LOG_ERROR("ERROR::TRACE::FILE_NOT_SUCCESFULLY_WRITTEN {}", path);
+            return false;
+        }
+
+        Registry& threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        std::vector<Event> events;
+        for (unsigned int t = 0; t < threads.buffers.size(); t++)
+        {
+            const Buffer& buffer = *threads.buffers[t];
+            if (!first)
+                out << ",\n";
+            first = false;
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id << ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+
+            // copy the published range, then drop whatever the owner overwrote while we were copying.
+            // Once the ring has wrapped, the slot of event after - CAPACITY is also the one the owner
+            // writes event after into, so it may be torn and is dropped too
+            uint64_t head = buffer.head.load(std::memory_order_acquire);
+            uint64_t begin = head > CAPACITY ? head - CAPACITY : 0;
+            events.clear();
+            for (uint64_t i = begin; i < head; i++)
+                events.push_back(buffer.events[i % CAPACITY]);
+            uint64_t after = buffer.head.load(std::memory_order_acquire);
+            uint64_t valid = after >= CAPACITY ? after - CAPACITY + 1 : 0;
+            for (uint64_t i = begin; i < head; i++)
+            {
+                if (i < valid)
+                    continue;
+                const Event& event = events[i - begin];
+                out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+                    << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+            }
+        }
+        out << "\n]}\n";
+        LOG_INFO("TRACE::WRITTEN {}", path);
+        return true;
+    }
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    struct Buffer {
+        // CAPACITY events once the thread records its first one, empty before
+        std::vector<Event> events;
+        std::atomic<uint64_t> head;
+        unsigned int id;
+        std::string name;
+
+        explicit Buffer(unsigned int id) : head(0), id(id), name("thread " + std::to_string(id)) {}
+    };
+
+    // every thread's buffer; shared so events survive the thread that recorded them
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Buffer> > buffers;
+    };
+
+    static std::atomic<bool>& enabledFlag()
+    {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    static Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    static Buffer& threadBuffer()
+    {
+        thread_local std::shared_ptr<Buffer> buffer;
+        if (!buffer)
+        {
+            Registry& threads = registry();
+            std::lock_guard<std::mutex> lock(threads.mutex);
+            buffer = std::make_shared<Buffer>((unsigned int)threads.buffers.size() + 1);
+            threads.buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+};
+
+// records the enclosing block as one event when tracing is enabled at its start
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : name(name), start(0), active(Trace::enabled())
+    {
+        if (active)
+            start = Trace::now();
+    }
+
+    ~TraceScope()
+    {
+        if (active)
+            Trace::record(name, start, Trace::now());
+    }
+
+private:
+    const char* name;
+    uint64_t start;
+    bool active;
+};
+
+#if SOLAR_SYSTEM_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+#endif
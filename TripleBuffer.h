@@ -0,0 +1,52 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free hand-over of the latest value from one writer thread to one reader thread.
+// Of the three slots the writer owns one (back), the reader owns one (front) and the third sits in
+// between holding the last published value. publish() swaps back with the middle and acquire() swaps
+// the middle with front when something new arrived, so neither side ever waits on the other and the
+// reader always sees the newest complete value. Slots are reused, so values holding vectors keep
+// their capacity from one round to the next.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // the writer's slot, fill it and then publish()
+    T& back()
+    {
+        return slots[backIndex];
+    }
+
+    // hands the back slot to the reader, the writer continues in the previous middle slot
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // takes the newest published slot as front if there is one; returns false when front is current
+    bool acquire()
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // the reader's slot, stays valid and unchanged until the next acquire()
+    T& front()
+    {
+        return slots[frontIndex];
+    }
+
+private:
+    static const unsigned int INDEX = 3;
+    static const unsigned int FRESH = 4;
+
+    T slots[3];
+    unsigned int backIndex = 0;
+    std::atomic<unsigned int> middle{ 1 };
+    unsigned int frontIndex = 2;
+};
+#endif
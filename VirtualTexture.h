@@ -0,0 +1,704 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "GLStats.h"
+#include "GpuMemory.h"
+#include "Log.h"
+#include "PageFile.h"
+#include "Shader.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Virtual texturing of the body surfaces: only the pages of each image that are on screen, at the
+// resolution they are seen at, are in video memory.
+// Every layer (same order as the body texture array) is read from a memory-mapped PageFile. Bodies
+// are first drawn at a fraction of the resolution with a feedback shader that writes the page and
+// mip each pixel needs; the target is read back asynchronously through a ring of pixel buffers like
+// the Hi-Z pyramid, so the pages requested are a frame or two old. Missing pages are copied out of the
+// mapping by a loader thread, coarse mips first, and uploaded into a fixed texture of page slots
+// which are recycled least recently used first. A mip-mapped page table per layer maps each virtual
+// page to the slot of the finest resident page covering it, which shader.frag samples through. The
+// single-page top mip of every layer is never evicted, so there is always something to draw.
+// Steady-state frames do not allocate: every list is reserved to the in-flight limit up front.
+class VirtualTexture
+{
+public:
+    // must match the arrays in shader.frag and vt_feedback.frag
+    static const int MAX_LAYERS = 8;
+    // pages read by the loader thread and not yet uploaded, at most
+    static const int STAGING_PAGES = 64;
+    static const int UPLOADS_PER_FRAME = 16;
+    // the feedback target is this many times smaller than the frame along each axis
+    static const int FEEDBACK_SCALE = 8;
+
+    // samples the pages instead of the texture array; only takes effect when supported, which is
+    // false when a page file is missing
+    bool enabled = true;
+    bool supported = false;
+    int layers = 0;
+    // page uploads and evictions since startup
+    unsigned long long uploads = 0;
+    unsigned long long evictions = 0;
+
+    // constructor, needs a current GL context; pageFiles from PageFile::prepare, one per layer.
+    // slotsPerAxis squared pages make up the physical cache
+    explicit VirtualTexture(const std::vector<std::string>& pageFiles, int slotsPerAxis = 16) : slotsPerAxis(slotsPerAxis)
+    {
+        layers = std::min((int)pageFiles.size(), (int)MAX_LAYERS);
+        files.resize(layers);
+        for (int layer = 0; layer < layers; layer++)
+        {
+            if (pageFiles[layer].empty() || !files[layer].open(pageFiles[layer]))
+            {
+                LOG_WARN("VIRTUAL_TEXTURE::DISABLED no page file for layer {}", layer);
+                return;
+            }
+        }
+        if (layers == 0 || slotsPerAxis * slotsPerAxis <= layers)
+            return;
+
+        createTables();
+        createPhysical();
+        glGenFramebuffers(1, &feedbackFBO);
+        glGenBuffers(READBACK_SLOTS, PBO);
+
+        requests.reserve(STAGING_PAGES);
+        loading.reserve(STAGING_PAGES);
+        loaded.reserve(STAGING_PAGES);
+        ready.reserve(STAGING_PAGES);
+        wants.reserve(MAX_WANTS);
+        staging.reset(new unsigned char[STAGING_PAGES * PageFile::PAGE_BYTES]);
+        freeStaging.reserve(STAGING_PAGES);
+        for (int i = STAGING_PAGES - 1; i >= 0; i--)
+            freeStaging.push_back(i);
+
+        // the coarsest page of every layer stays resident for good
+        for (int layer = 0; layer < layers; layer++)
+        {
+            const int top = (int)files[layer].header.mips - 1;
+            upload(layer, top, 0, 0, files[layer].page(top, 0, 0), true);
+        }
+        flushTables();
+
+        supported = true;
+        thread = std::thread(&VirtualTexture::run, this);
+    }
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    ~VirtualTexture()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable())
+            thread.join();
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+            discardReadback(slot);
+        if (feedbackFBO != 0)
+        {
+            GpuMemory::deleteBuffers(READBACK_SLOTS, PBO);
+            GpuMemory::deleteRenderbuffers(2, feedbackTargets);
+            glDeleteFramebuffers(1, &feedbackFBO);
+        }
+        GpuMemory::deleteTextures(1, &pageTable);
+        GpuMemory::deleteTextures(1, &physical);
+    }
+
+    // pages in the physical cache and pages the loader is working on
+    int residentPages() const
+    {
+        return resident;
+    }
+
+    int loadingPages() const
+    {
+        return STAGING_PAGES - (int)freeStaging.size();
+    }
+
+    bool active() const
+    {
+        return enabled && supported;
+    }
+
+    int slotCount() const
+    {
+        return slotsPerAxis * slotsPerAxis;
+    }
+
+    // the next frame draws something different from the last one, e.g. the camera moved
+    void markChanged()
+    {
+        changeFrame = frame + 1;
+    }
+
+    // true until the pages the current image needs are all in: while pages are on their way, and
+    // until a feedback drawn after the last upload or markChanged() has been read. A frame that is
+    // not redrawn meanwhile keeps showing the coarser pages
+    bool streaming() const
+    {
+        return active() && (loadingPages() > 0 || !wants.empty() || feedbackFrame < std::max(lastUpload, changeFrame));
+    }
+
+    // the feedback target follows the frame size
+    void resize(int width, int height)
+    {
+        width = std::max(1, (width + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE);
+        height = std::max(1, (height + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE);
+        if (!supported || (width == feedbackWidth && height == feedbackHeight))
+            return;
+        feedbackWidth = width;
+        feedbackHeight = height;
+
+        if (feedbackTargets[0] != 0)
+            GpuMemory::deleteRenderbuffers(2, feedbackTargets);
+        glGenRenderbuffers(2, feedbackTargets);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackTargets[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+        GpuMemory::track(GpuMemory::RENDERBUFFER, feedbackTargets[0], (unsigned long long)width * height * 4, "VirtualTexture", "feedback");
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackTargets[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        GpuMemory::track(GpuMemory::RENDERBUFFER, feedbackTargets[1], (unsigned long long)width * height * 4, "VirtualTexture", "feedback depth");
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackTargets[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackTargets[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            LOG_ERROR("ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[slot]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+            GpuMemory::track(GpuMemory::BUFFER, PBO[slot], (unsigned long long)width * height * 4, "VirtualTexture", "feedback readback");
+            discardReadback(slot);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // start of a frame: turns the newest feedback that has arrived into page requests and uploads
+    // pages the loader has finished, within the per-frame budget
+    void update()
+    {
+        if (!supported)
+            return;
+        frame++;
+        collectFeedback();
+        requestPages();
+
+        // finished pages, uploaded oldest first
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int i = 0; i < loaded.size(); i++)
+                ready.push_back(loaded[i]);
+            loaded.clear();
+        }
+        const int count = std::min((int)ready.size(), (int)UPLOADS_PER_FRAME);
+        for (int i = 0; i < count; i++)
+        {
+            const Request& page = ready[i];
+            upload(page.layer, page.mip, page.x, page.y, stagingPage(page.staging), false);
+            freeStaging.push_back(page.staging);
+        }
+        ready.erase(ready.begin(), ready.begin() + count);
+        flushTables();
+    }
+
+    // binds the feedback target and clears it to "no page"; draw the opaque bodies with the feedback
+    // shader after setUniforms(), then call endFeedback()
+    void beginFeedback()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glViewport(0, 0, feedbackWidth, feedbackHeight);
+        const GLuint none[4] = { NO_PAGE, NO_PAGE, NO_PAGE, NO_PAGE };
+        glClearBufferuiv(GL_COLOR, 0, none);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
+
+    // queues the readback of the feedback without waiting for it
+    void endFeedback()
+    {
+        discardReadback(nextSlot);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[nextSlot]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[nextSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotFrame[nextSlot] = frame;
+        nextSlot = (nextSlot + 1) % READBACK_SLOTS;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // the layer sizes and mip bias for shader.frag and the feedback shader, which must be in use;
+    // binds the page table and the physical pages for sampling
+    void setUniforms(const Shader& shader, float mipBias, unsigned int tableUnit, unsigned int physicalUnit) const
+    {
+        glUniform2fv(glGetUniformLocation(shader.ID, "layerPages"), layers, layerPages);
+        glUniform1iv(glGetUniformLocation(shader.ID, "layerMips"), layers, layerMips);
+        glUniform1f(glGetUniformLocation(shader.ID, "pageSize"), (float)PageFile::PAGE_SIZE);
+        glUniform1f(glGetUniformLocation(shader.ID, "pageBorder"), (float)PageFile::BORDER);
+        glUniform1f(glGetUniformLocation(shader.ID, "physicalSize"), (float)(slotsPerAxis * PageFile::PADDED_SIZE));
+        glUniform1f(glGetUniformLocation(shader.ID, "mipBias"), mipBias);
+        glActiveTexture(GL_TEXTURE0 + tableUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+        glActiveTexture(GL_TEXTURE0 + physicalUnit);
+        glBindTexture(GL_TEXTURE_2D, physical);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // mip bias of the feedback pass: its derivatives are FEEDBACK_SCALE times those of the frame
+    static float feedbackMipBias()
+    {
+        float bias = 0.0f;
+        for (int scale = FEEDBACK_SCALE; scale > 1; scale /= 2)
+            bias -= 1.0f;
+        return bias;
+    }
+
+private:
+    static const int READBACK_SLOTS = 3;
+    // distinct missing pages considered per feedback
+    static const int MAX_WANTS = 1024;
+    static const GLuint NO_PAGE = 0xFFFFFFFFu;
+    // page states besides a slot index
+    static const int ABSENT = -1;
+    static const int LOADING = -2;
+
+    // a page on its way from the page file to a slot
+    struct Request {
+        int layer;
+        int mip;
+        int x;
+        int y;
+        int staging;
+    };
+
+    // what a physical slot holds
+    struct Slot {
+        int layer;
+        int mip;
+        int x;
+        int y;
+        unsigned long long lastUsed;
+        bool pinned;
+    };
+
+    // per layer and mip: the state of every page, ABSENT, LOADING or its slot, and the frame it was
+    // last wanted in
+    struct Level {
+        int pagesX;
+        int pagesY;
+        std::vector<int> state;
+        std::vector<unsigned long long> wanted;
+    };
+
+    int slotsPerAxis;
+    std::vector<PageFile> files;
+    std::vector<std::vector<Level> > levels;
+    std::vector<Slot> slots;
+    int resident = 0;
+    float layerPages[2 * MAX_LAYERS] = {};
+    int layerMips[MAX_LAYERS] = {};
+    unsigned long long frame = 0;
+    unsigned long long lastUpload = 0;
+    unsigned long long changeFrame = 0;
+
+    // page table: one RGBA8 texel per page, slot x, slot y and the mip of the page the slot holds;
+    // GPU level m is tableWidth >> m wide, every layer uses its top-left corner. CPU copy per mip,
+    // layer after layer, with the rectangle each layer changed since the last flush
+    unsigned int pageTable = 0;
+    int tableWidth = 0;
+    int tableHeight = 0;
+    int tableMips = 0;
+    std::vector<std::vector<unsigned int> > tables;
+    struct Dirty {
+        int x0, y0, x1, y1;
+    };
+    std::vector<Dirty> dirty;
+
+    unsigned int physical = 0;
+
+    // feedback target and its asynchronous readback ring
+    unsigned int feedbackFBO = 0;
+    unsigned int feedbackTargets[2] = {};
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    unsigned int PBO[READBACK_SLOTS] = {};
+    GLsync fences[READBACK_SLOTS] = {};
+    unsigned long long slotFrame[READBACK_SLOTS] = {};
+    int nextSlot = 0;
+    // frame the last consumed feedback was drawn in
+    unsigned long long feedbackFrame = 0;
+    std::vector<Request> wants;
+
+    // loader thread; requests and loaded are guarded by mutex, the rest belongs to the render thread
+    std::unique_ptr<unsigned char[]> staging;
+    std::vector<int> freeStaging;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<Request> requests;
+    std::vector<Request> loaded;
+    std::vector<Request> loading;
+    std::vector<Request> ready;
+    std::thread thread;
+
+    unsigned char* stagingPage(int index) const
+    {
+        return staging.get() + (size_t)index * PageFile::PAGE_BYTES;
+    }
+
+    static unsigned int packEntry(int slotX, int slotY, int mip)
+    {
+        return (unsigned int)slotX | ((unsigned int)slotY << 8) | ((unsigned int)mip << 16) | (255u << 24);
+    }
+
+    int tableLevelWidth(int mip) const
+    {
+        return std::max(1, tableWidth >> mip);
+    }
+
+    int tableLevelHeight(int mip) const
+    {
+        return std::max(1, tableHeight >> mip);
+    }
+
+    unsigned int& tableEntry(int layer, int mip, int x, int y)
+    {
+        const int width = tableLevelWidth(mip);
+        return tables[mip][((size_t)layer * tableLevelHeight(mip) + y) * width + x];
+    }
+
+    void createTables()
+    {
+        levels.resize(layers);
+        for (int layer = 0; layer < layers; layer++)
+        {
+            const PageFile& file = files[layer];
+            tableWidth = std::max(tableWidth, (int)file.header.pagesX);
+            tableHeight = std::max(tableHeight, (int)file.header.pagesY);
+            tableMips = std::max(tableMips, (int)file.header.mips);
+            layerPages[2 * layer] = (float)file.header.pagesX;
+            layerPages[2 * layer + 1] = (float)file.header.pagesY;
+            layerMips[layer] = (int)file.header.mips;
+            levels[layer].resize(file.header.mips);
+            for (int mip = 0; mip < (int)file.header.mips; mip++)
+            {
+                Level& level = levels[layer][mip];
+                level.pagesX = file.pagesX(mip);
+                level.pagesY = file.pagesY(mip);
+                level.state.assign((size_t)level.pagesX * level.pagesY, (int)ABSENT);
+                level.wanted.assign((size_t)level.pagesX * level.pagesY, 0);
+            }
+        }
+
+        tables.resize(tableMips);
+        dirty.resize((size_t)tableMips * layers);
+        glGenTextures(1, &pageTable);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+        unsigned long long bytes = 0;
+        for (int mip = 0; mip < tableMips; mip++)
+        {
+            tables[mip].assign((size_t)tableLevelWidth(mip) * tableLevelHeight(mip) * layers, 0);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, GL_RGBA8, tableLevelWidth(mip), tableLevelHeight(mip), layers, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, tables[mip].data());
+            bytes += (unsigned long long)tables[mip].size() * 4;
+            for (int layer = 0; layer < layers; layer++)
+                dirty[(size_t)mip * layers + layer] = { 0, 0, 0, 0 };
+        }
+        GpuMemory::track(GpuMemory::TEXTURE, pageTable, bytes, "VirtualTexture", "page table");
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, tableMips - 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void createPhysical()
+    {
+        const int size = slotsPerAxis * PageFile::PADDED_SIZE;
+        glGenTextures(1, &physical);
+        glBindTexture(GL_TEXTURE_2D, physical);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GpuMemory::track(GpuMemory::TEXTURE, physical, GpuMemory::textureBytes(size, size, 1, 4, false), "VirtualTexture", "physical pages");
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        Slot empty = { -1, 0, 0, 0, 0, false };
+        slots.assign(slotCount(), empty);
+    }
+
+    void discardReadback(int slot)
+    {
+        if (fences[slot])
+            glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+        slotFrame[slot] = 0;
+    }
+
+    // scans the newest finished readback, never waiting on the GPU: touches the resident pages it
+    // shows and collects the missing ones into wants
+    void collectFeedback()
+    {
+        int newest = -1;
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+        {
+            if (!fences[slot] || (newest >= 0 && slotFrame[slot] < slotFrame[newest]))
+                continue;
+            GLenum status = glClientWaitSync(fences[slot], 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+                newest = slot;
+        }
+        if (newest < 0)
+            return;
+
+        wants.clear();
+        const size_t count = (size_t)feedbackWidth * feedbackHeight;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[newest]);
+        const GLuint* pixels = (const GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4, GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            GLuint previous = NO_PAGE;
+            for (size_t i = 0; i < count; i++)
+            {
+                // neighbouring pixels mostly want the same page
+                if (pixels[i] == NO_PAGE || pixels[i] == previous)
+                    continue;
+                previous = pixels[i];
+                want(previous >> 28, (previous >> 24) & 15, previous & 4095, (previous >> 12) & 4095);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackFrame = slotFrame[newest];
+
+        const unsigned long long consumed = slotFrame[newest];
+        for (int slot = 0; slot < READBACK_SLOTS; slot++)
+            if (fences[slot] && slotFrame[slot] <= consumed)
+                discardReadback(slot);
+    }
+
+    void want(unsigned int layer, unsigned int mip, unsigned int x, unsigned int y)
+    {
+        if ((int)layer >= layers || mip >= levels[layer].size())
+            return;
+        Level& level = levels[layer][mip];
+        if ((int)x >= level.pagesX || (int)y >= level.pagesY)
+            return;
+        const size_t index = (size_t)y * level.pagesX + x;
+        if (level.wanted[index] == frame)
+            return;
+        level.wanted[index] = frame;
+        const int state = level.state[index];
+        if (state >= 0)
+        {
+            slots[state].lastUsed = frame;
+            return;
+        }
+
+        // until it arrives the page is drawn from the finest resident ancestor, keep that one too
+        for (unsigned int parent = mip + 1; parent < levels[layer].size(); parent++)
+        {
+            const Level& coarser = levels[layer][parent];
+            const int px = (int)((unsigned long long)x * coarser.pagesX / level.pagesX);
+            const int py = (int)((unsigned long long)y * coarser.pagesY / level.pagesY);
+            const int ancestor = coarser.state[(size_t)py * coarser.pagesX + px];
+            if (ancestor >= 0)
+            {
+                slots[ancestor].lastUsed = frame;
+                break;
+            }
+        }
+        if (state == ABSENT && wants.size() < wants.capacity())
+        {
+            Request request = { (int)layer, (int)mip, (int)x, (int)y, -1 };
+            wants.push_back(request);
+        }
+    }
+
+    // hands the loader as many wanted pages as there is staging for, coarse mips first so detail
+    // refines progressively
+    void requestPages()
+    {
+        if (wants.empty() || freeStaging.empty())
+            return;
+        std::sort(wants.begin(), wants.end(), [](const Request& a, const Request& b) { return a.mip > b.mip; });
+        unsigned int issued = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (; issued < wants.size() && !freeStaging.empty(); issued++)
+            {
+                Request request = wants[issued];
+                Level& level = levels[request.layer][request.mip];
+                int& state = level.state[(size_t)request.y * level.pagesX + request.x];
+                if (state != ABSENT)
+                    continue;
+                state = LOADING;
+                request.staging = freeStaging.back();
+                freeStaging.pop_back();
+                requests.push_back(request);
+            }
+        }
+        wake.notify_one();
+        wants.erase(wants.begin(), wants.begin() + issued);
+    }
+
+    // copies requested pages out of the mapping; the only place that waits for the disk
+    void run()
+    {
+        Trace::setThreadName("page loader");
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+                if (stopping)
+                    return;
+                std::swap(loading, requests);
+            }
+            {
+                TRACE_SCOPE("load pages");
+                for (unsigned int i = 0; i < loading.size(); i++)
+                {
+                    const Request& page = loading[i];
+                    std::memcpy(stagingPage(page.staging), files[page.layer].page(page.mip, page.x, page.y), PageFile::PAGE_BYTES);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int i = 0; i < loading.size(); i++)
+                loaded.push_back(loading[i]);
+            loading.clear();
+        }
+    }
+
+    // the slot a new page goes into: a free one, or the least recently used page not wanted by the
+    // last feedback; -1 when every slot is still in use
+    int takeSlot()
+    {
+        int victim = -1;
+        for (int i = 0; i < (int)slots.size(); i++)
+        {
+            if (slots[i].layer < 0)
+                return i;
+            if (!slots[i].pinned && slots[i].lastUsed < frame && (victim < 0 || slots[i].lastUsed < slots[victim].lastUsed))
+                victim = i;
+        }
+        if (victim < 0)
+            return -1;
+        Slot& old = slots[victim];
+        Level& level = levels[old.layer][old.mip];
+        level.state[(size_t)old.y * level.pagesX + old.x] = ABSENT;
+        refresh(old.layer, old.mip, old.x, old.y);
+        old.layer = -1;
+        resident--;
+        evictions++;
+        return victim;
+    }
+
+    void upload(int layer, int mip, int x, int y, const unsigned char* pixels, bool pinned)
+    {
+        Level& level = levels[layer][mip];
+        const size_t index = (size_t)y * level.pagesX + x;
+        const int slot = takeSlot();
+        if (slot < 0)
+        {
+            // thrashing: the cache is too small for the frame, the page is asked for again later
+            level.state[index] = ABSENT;
+            return;
+        }
+        glBindTexture(GL_TEXTURE_2D, physical);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotsPerAxis) * PageFile::PADDED_SIZE, (slot / slotsPerAxis) * PageFile::PADDED_SIZE,
+                        PageFile::PADDED_SIZE, PageFile::PADDED_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLStats::addUpload(PageFile::PAGE_BYTES);
+
+        Slot taken = { layer, mip, x, y, frame, pinned };
+        slots[slot] = taken;
+        level.state[index] = slot;
+        refresh(layer, mip, x, y);
+        resident++;
+        uploads++;
+        lastUpload = frame;
+    }
+
+    // rewrites the page table under page (x, y) of mip: every finer page without a resident page of
+    // its own falls back to its parent's entry
+    void refresh(int layer, int mip, int x, int y)
+    {
+        const Level& top = levels[layer][mip];
+        for (int m = mip; m >= 0; m--)
+        {
+            const Level& level = levels[layer][m];
+            const int x0 = x * level.pagesX / top.pagesX;
+            const int y0 = y * level.pagesY / top.pagesY;
+            const int x1 = (x + 1) * level.pagesX / top.pagesX;
+            const int y1 = (y + 1) * level.pagesY / top.pagesY;
+            for (int py = y0; py < y1; py++)
+            {
+                for (int px = x0; px < x1; px++)
+                {
+                    const int state = level.state[(size_t)py * level.pagesX + px];
+                    unsigned int entry = 0;
+                    if (state >= 0)
+                        entry = packEntry(state % slotsPerAxis, state / slotsPerAxis, m);
+                    else if (m + 1 < (int)levels[layer].size())
+                    {
+                        const Level& parent = levels[layer][m + 1];
+                        entry = tableEntry(layer, m + 1, px * parent.pagesX / level.pagesX, py * parent.pagesY / level.pagesY);
+                    }
+                    tableEntry(layer, m, px, py) = entry;
+                }
+            }
+            Dirty& rect = dirty[(size_t)m * layers + layer];
+            if (rect.x1 == rect.x0)
+                rect = { x0, y0, x1, y1 };
+            else
+                rect = { std::min(rect.x0, x0), std::min(rect.y0, y0), std::max(rect.x1, x1), std::max(rect.y1, y1) };
+        }
+    }
+
+    // uploads the changed rectangles of the page table
+    void flushTables()
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (int mip = 0; mip < tableMips; mip++)
+        {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, tableLevelWidth(mip));
+            for (int layer = 0; layer < layers; layer++)
+            {
+                Dirty& rect = dirty[(size_t)mip * layers + layer];
+                if (rect.x1 == rect.x0)
+                    continue;
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, rect.x0, rect.y0, layer, rect.x1 - rect.x0, rect.y1 - rect.y0, 1, GL_RGBA,
+                                GL_UNSIGNED_BYTE, &tableEntry(layer, mip, rect.x0, rect.y0));
+                GLStats::addUpload((unsigned long long)(rect.x1 - rect.x0) * (rect.y1 - rect.y0) * 4);
+                rect = { 0, 0, 0, 0 };
+            }
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+};
+#endif
@@ -0,0 +1,194 @@
+// Micro-benchmarks for the engine's hot paths, Google Benchmark style.
+// Every input is fixed (shipped OBJs, seeded scene, constant parameters) so numbers are comparable
+// between builds. Loading and Shader benchmarks need GL, so a headless context is created first.
+//   OpenGLGP_benchmarks [--benchmark_filter=<regex>] [--benchmark_repetitions=N] ...
+#include <benchmark/benchmark.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "Bench.h"
+#include "Cone.h"
+#include "Log.h"
+#include "Model.h"
+#include "ObjLoader.h"
+#include "Scene.h"
+#include "Shader.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifndef SOLAR_SYSTEM_MODELS_DIR
+#define SOLAR_SYSTEM_MODELS_DIR "../../res/models/"
+#endif
+#ifndef SOLAR_SYSTEM_SHADER_DIR
+#define SOLAR_SYSTEM_SHADER_DIR ""
+#endif
+
+static const char* MODEL_FILES[] = { "sphere.obj", "Sattelite.obj", "orbit.obj", "planet.obj", "solid.obj" };
+
+// the cone the moons and stars are drawn with, over the "Degrees step" slider range
+static void BM_CreateCone(benchmark::State& state)
+{
+    std::vector<glm::vec3> vertices;
+    for (auto _ : state)
+    {
+        createCone(vertices, (int)state.range(0), 2.0f);
+        benchmark::DoNotOptimize(vertices.data());
+    }
+    state.counters["vertices"] = (double)vertices.size();
+}
+BENCHMARK(BM_CreateCone)->Arg(1)->Arg(5)->Arg(10)->Arg(30)->Arg(50)->Arg(60);
+
+// import, optimization and GL upload of a whole OBJ, as at startup
+static void BM_LoadModel(benchmark::State& state, std::string path)
+{
+    for (auto _ : state)
+    {
+        Model model(path);
+        benchmark::DoNotOptimize(model.meshes.data());
+    }
+}
+
+// only the assimp -> Mesh conversion of an already imported OBJ
+static void BM_ProcessMesh(benchmark::State& state, std::string path)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || !scene->mRootNode || scene->mNumMeshes == 0)
+    {
+        state.SkipWithError("model failed to import");
+        return;
+    }
+    Model model(path);
+    unsigned int triangles = 0;
+    for (auto _ : state)
+    {
+        triangles = 0;
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+        {
+            Mesh mesh = model.processMesh(scene->mMeshes[i], scene);
+            triangles += (unsigned int)mesh.indices.size() / 3;
+            benchmark::DoNotOptimize(mesh.VAO);
+        }
+    }
+    state.counters["triangles"] = triangles;
+}
+
+// the OBJ fast path up to the vertex and index arrays, without optimization or upload
+static void BM_ParseObj(benchmark::State& state, std::string path)
+{
+    unsigned int triangles = 0;
+    for (auto _ : state)
+    {
+        ObjModel obj;
+        if (!ObjLoader::load(path, obj))
+        {
+            state.SkipWithError("model failed to parse");
+            return;
+        }
+        triangles = 0;
+        for (unsigned int i = 0; i < obj.meshes.size(); i++)
+            triangles += (unsigned int)obj.meshes[i].indices.size() / 3;
+        benchmark::DoNotOptimize(obj.meshes.data());
+    }
+    state.counters["triangles"] = triangles;
+}
+
+// the Assimp import BM_ParseObj replaces for OBJ files, with the same post-processing
+static void BM_ImportAssimp(benchmark::State& state, std::string path)
+{
+    for (auto _ : state)
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        benchmark::DoNotOptimize(scene);
+    }
+}
+
+// one planet's orbital transform chain, Scene::planetTransform with planet 3's parameters
+static void BM_TransformChain(benchmark::State& state)
+{
+    glm::mat4 system = glm::scale(glm::mat4(1.0f), glm::vec3(0.0256f));
+    float atime = 1.0f;
+    for (auto _ : state)
+    {
+        glm::mat4 planet = Scene::planetTransform(system, atime, 45.0f, 62.0f, 2.5f, 10.0f, 130.0f);
+        benchmark::DoNotOptimize(planet);
+        atime += 0.01f;
+    }
+}
+BENCHMARK(BM_TransformChain);
+
+// the whole per-frame traversal, with the asteroid belt scaled up
+static void BM_SceneUpdate(benchmark::State& state)
+{
+    srand(1);
+    Scene scene;
+    scene.generateStars(250);
+    scene.generateAsteroids((int)state.range(0));
+    float atime = 0.0f;
+    for (auto _ : state)
+    {
+        scene.update(atime, 0.25f, 0.0f, 0.0f, 0.5f);
+        benchmark::DoNotOptimize(scene.bodies.data());
+        atime += 0.01f;
+    }
+    state.counters["bodies"] = (double)scene.bodies.size();
+    state.SetItemsProcessed(state.iterations() * (int64_t)scene.bodies.size());
+}
+BENCHMARK(BM_SceneUpdate)->Arg(0)->Arg(1000)->Arg(10000);
+
+// the uniform setters the render loop calls every frame; each looks the location up by name
+static void BM_ShaderSetters(benchmark::State& state)
+{
+    Shader shader(SOLAR_SYSTEM_SHADER_DIR "shader.vert", SOLAR_SYSTEM_SHADER_DIR "shader.frag");
+    shader.use();
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1400.0f / 900.0f, 0.1f, 100.0f);
+    for (auto _ : state)
+    {
+        shader.setInt("oit_pass", 0);
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        shader.setInt("bodyTextures", 0);
+    }
+    state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_ShaderSetters);
+
+int main(int argc, char** argv)
+{
+    HeadlessContext context;
+    if (!context.create())
+    {
+        LOG_ERROR("ERROR::BENCHMARK::CONTEXT_CREATION_FAILED");
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < sizeof(MODEL_FILES) / sizeof(MODEL_FILES[0]); i++)
+    {
+        std::string path = std::string(SOLAR_SYSTEM_MODELS_DIR) + MODEL_FILES[i];
+        benchmark::RegisterBenchmark((std::string("BM_LoadModel/") + MODEL_FILES[i]).c_str(), BM_LoadModel, path);
+        benchmark::RegisterBenchmark((std::string("BM_ProcessMesh/") + MODEL_FILES[i]).c_str(), BM_ProcessMesh, path);
+        benchmark::RegisterBenchmark((std::string("BM_ParseObj/") + MODEL_FILES[i]).c_str(), BM_ParseObj, path);
+        benchmark::RegisterBenchmark((std::string("BM_ImportAssimp/") + MODEL_FILES[i]).c_str(), BM_ImportAssimp, path);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    // the loaders log every mesh they optimize; keep that out of the timings and the report
+    spdlog::set_level(spdlog::level::warn);
+    benchmark::RunSpecifiedBenchmarks();
+
+    benchmark::Shutdown();
+    context.destroy();
+    return 0;
+}
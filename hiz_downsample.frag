@@ -0,0 +1,25 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D source;
+uniform ivec2 sourceSize;
+
+// max-reduces a 2x2 footprint of the source level, so every Hi-Z texel holds the farthest depth it covers
+void main()
+{
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+
+    // odd source dimensions fold the extra row/column into the last texel to keep the reduction conservative
+    ivec2 extent = ivec2(2, 2);
+    if (base.x + 3 == sourceSize.x)
+        extent.x = 3;
+    if (base.y + 3 == sourceSize.y)
+        extent.y = 3;
+
+    float depth = 0.0;
+    for (int y = 0; y < extent.y; y++)
+        for (int x = 0; x < extent.x; x++)
+            depth = max(depth, texelFetch(source, min(base + ivec2(x, y), sourceSize - 1), 0).r);
+
+    FragColor = vec4(depth);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;
+uniform sampler2D weightTexture;
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, coord, 0);
+    float revealage = accum.a;
+
+    // no translucent surface covered this pixel
+    if (revealage >= 1.0)
+        discard;
+
+    float weight = texelFetch(weightTexture, coord, 0).r;
+    vec3 average = accum.rgb / clamp(weight, 1e-5, 5e4);
+    FragColor = vec4(average, 1.0 - revealage);
+}
@@ -1,17 +1,58 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 FragWeight;
 
 in vec2 TexCoord;
 in vec4 color;
+flat in float layer;
 
-uniform sampler2D texture;
-uniform sampler2D texture_diffuse1;
-uniform int is_texture;
+uniform sampler2DArray bodyTextures;
+uniform int oit_pass;
+
+// virtual texturing, see VirtualTexture: the page table gives for every page of every mip the slot
+// of the finest resident page covering it in the physical page cache
+uniform bool virtualTexturing;
+uniform sampler2DArray pageTable;
+uniform sampler2D physicalPages;
+uniform vec2 layerPages[8];
+uniform int layerMips[8];
+uniform float pageSize;
+uniform float pageBorder;
+uniform float physicalSize;
+uniform float mipBias;
+
+vec4 sampleVirtual(vec2 uv, int l)
+{
+	vec2 texels = uv * layerPages[l] * pageSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	int mip = clamp(int(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + mipBias), 0, layerMips[l] - 1);
+
+	uv = clamp(uv, 0.0, 0.99999);
+	vec4 entry = floor(texelFetch(pageTable, ivec3(uv * max(layerPages[l] / float(1 << mip), vec2(1.0)), l), mip) * 255.0 + 0.5);
+	// the slot may hold a coarser page than mip while the finer one streams in
+	vec2 inPage = fract(uv * max(layerPages[l] / exp2(entry.b), vec2(1.0)));
+	vec2 texel = entry.rg * (pageSize + 2.0 * pageBorder) + pageBorder + inPage * pageSize;
+	return textureLod(physicalPages, texel / physicalSize, 0.0);
+}
 
 void main()
 {   
-	if(is_texture == 1)
-		FragColor = texture(texture_diffuse1, TexCoord) * color;
+	vec4 result;
+	if(layer >= 0.0 && virtualTexturing)
+		result = sampleVirtual(TexCoord, int(layer + 0.5)) * color;
+	else if(layer >= 0.0)
+		result = texture(bodyTextures, vec3(TexCoord, layer)) * color;
+	else
+		result = color;
+
+	if(oit_pass == 1)
+	{
+		// weighted blended OIT: depth weight from McGuire & Bavoil, eq. 10
+		float weight = clamp(pow(min(1.0, result.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+		FragColor = vec4(result.rgb * result.a * weight, result.a);
+		FragWeight = vec4(result.a * weight);
+	}
 	else
-		FragColor = color;
-}
\ No newline at end of file
+		FragColor = result;
+}
@@ -2,19 +2,22 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance body data, see BodyInstance
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec4 instanceColor;
+layout (location = 8) in float instanceLayer;
 
 out vec2 TexCoord;
 out vec4 color;
+flat out float layer;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
-uniform vec4 ourColor;
-
 void main()
 {
 	TexCoord = aTexCoords;   
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-	color = ourColor;
-}
\ No newline at end of file
+    gl_Position = projection * view * instanceModel * vec4(aPos, 1.0);
+	color = instanceColor;
+	layer = instanceLayer;
+}
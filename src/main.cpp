@@ -17,22 +17,62 @@
 #endif
 
 #include <GLFW/glfw3.h> // Include glfw3.h after our OpenGL definitions
-#include <spdlog/spdlog.h>
 
+// first, it sets the compile-time log level before anything includes spdlog
+#include "..\..\src\Log.h"
 #include "..\..\src\Mesh.h"
 #include "..\..\src\Shader.h"
 #include "..\..\src\Model.h"
 #include "..\..\src\Camera.h"
+#include "..\..\src\Profiler.h"
+#include "..\..\src\SolarSystem.h"
+#include "..\..\src\Bench.h"
+#include "..\..\src\Regression.h"
+#include "..\..\src\GLStats.h"
+#include "..\..\src\GpuMemory.h"
+#include "..\..\src\Trace.h"
+#include "..\..\src\ThreadPool.h"
+#include "..\..\src\StartupGraph.h"
+#include "..\..\src\Simulation.h"
+#include "..\..\src\AssetLoader.h"
+#include "..\..\src\FramePacer.h"
+#include "..\..\src\RenderOnDemand.h"
+#include "..\..\src\FrameArena.h"
+#include "..\..\src\ShaderHotReload.h"
 
 #define PI 3.14159265
-#define Cos(th) cos(PI/180*(th))
-#define Sin(th) sin(PI/180*(th))
 
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+void renderLoop(GLFWwindow* window, SolarSystem& system, const std::string& traceFile);
+Simulation::Settings simulationSettings();
+
+// everything the scene image depends on, to tell when it has to be drawn again
+struct SceneState {
+    glm::mat4 view;
+    glm::mat4 projection;
+    int width;
+    int height;
+    unsigned long long step;
+    int sideDegree;
+    bool wireframe;
+    bool virtualTexturing;
+
+    bool operator!=(const SceneState& other) const
+    {
+        return view != other.view || projection != other.projection || width != other.width || height != other.height ||
+               step != other.step || sideDegree != other.sideDegree || wireframe != other.wireframe ||
+               virtualTexturing != other.virtualTexturing;
+    }
+};
 
 // settings
 const unsigned int SCR_WIDTH = 1400;
@@ -44,9 +84,7 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 
 // timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-float atime = 0.0f;
+double deltaTime = 0.0;
 
 // VARIABLES
 float x_rotation = 0.25;
@@ -57,463 +95,457 @@ bool wireframe_mode = false;
 float speed = 0.02f;
 int sideDegree = 50;
 float transparency = 0.5f;
+int asteroidCount = 0;
 
-unsigned int VAO;
-unsigned int VBO;
+Profiler profiler;
 
-std::vector <glm::mat4> models;
-std::vector <glm::vec3> vertices;
-std::vector <glm::vec3> orbit_vertices;
-std::vector <glm::vec3> stars;
+#ifndef NDEBUG
+// debug builds count every heap allocation per thread, for the steady-state frame check
+void* operator new(std::size_t size)
+{
+    HeapCheck::noteAllocation();
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+    throw std::bad_alloc();
+}
 
-// METHODS
-void generateTexture(GLuint tex, const char* filename);
-void createCone(int sides, float height);
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
 
-int main()
+void operator delete(void* memory, std::size_t) noexcept
 {
-    // glfw: initialize and configure
+    std::free(memory);
+}
+#endif
+
+// for the time-to-first-frame report
+const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+int main(int argc, char** argv)
+{
+    LogSession logging;
+    BenchOptions bench;
+    if (!parseBenchOptions(argc, argv, bench))
+        return -1;
+    if (bench.enabled)
+        return runBench(bench);
+    if (bench.regress)
+        return runRegression(bench);
+    Trace::setThreadName("main");
+    Trace::setEnabled(!bench.trace.empty());
+    std::string traceFile = bench.trace.empty() ? "trace.json" : bench.trace;
+
+    // startup graph: parsing and decoding run on the pool while the window, context and shaders come
+    // up on this thread, then everything is uploaded in one go
+    ThreadPool pool;
+    StartupGraph startup;
     const char* glsl_version = "#version 430";
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = NULL;
+    SolarSystemAssets assets;
+    assets.bodyTextures.reset(new TextureArray(SolarSystemAssets::bodyTexturePaths(), 1024, 1024, false));
+    DecodedImage icon;
+    std::unique_ptr<SolarSystem> system;
+    bool imguiReady = false;
+
+    int createWindow = startup.add("create window", StartupGraph::MAIN, [&]() {
+        // glfw: initialize and configure
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        // macOS stops at 4.1, which leaves GPU culling unavailable
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Solar System", NULL, NULL);
-    if (window == NULL)
+        // glfw window creation
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Solar System", NULL, NULL);
+        if (window == NULL)
+        {
+            LOG_ERROR("Failed to create GLFW window");
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // glad: load all OpenGL function pointers
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            LOG_ERROR("Failed to initialize GLAD");
+            return false;
+        }
+        GLStats::install();
+
+        // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
+        //stbi_set_flip_vertically_on_load(true);
+
+        // configure global opengl state
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        return true;
+    });
+    int decodeIcon = startup.add("decode icon", StartupGraph::ANY, [&]() {
+        icon = DecodeImage("../../Textures/sattelite_icon.png", 4); //rgba channels
+        return true;
+    });
+    startup.add("set window icon", StartupGraph::MAIN, [&]() {
+        if (icon.pixels)
+        {
+            GLFWimage images[1];
+            images[0].width = icon.width;
+            images[0].height = icon.height;
+            images[0].pixels = icon.pixels.get();
+            glfwSetWindowIcon(window, 1, images);
+        }
+        return true;
+    }, { createWindow, decodeIcon });
+
+    // build and compile shaders, load models and textures
+    int compileShaders = startup.add("compile shaders", StartupGraph::MAIN, [&]() {
+        assets.shader.reset(new Shader("shader.vert", "shader.frag"));
+        return true;
+    }, { createWindow });
+    std::vector<int> assetTasks;
+    assetTasks.push_back(compileShaders);
+    assetTasks.push_back(startup.add("parse sphere.obj", StartupGraph::ANY, [&]() {
+        assets.planet.reset(new Model(SolarSystemAssets::planetPath(), false, false));
+        return true;
+    }));
+    assetTasks.push_back(startup.add("parse Sattelite.obj", StartupGraph::ANY, [&]() {
+        assets.sattelite.reset(new Model(SolarSystemAssets::sattelitePath(), false, false));
+        return true;
+    }));
+    assetTasks.push_back(startup.add("parse orbit.obj", StartupGraph::ANY, [&]() {
+        assets.orbit.reset(new Model(SolarSystemAssets::orbitPath(), false, false));
+        return true;
+    }));
+    for (int layer = 0; layer < assets.bodyTextures->layers; layer++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        assetTasks.push_back(startup.add("decode texture " + std::to_string(layer), StartupGraph::ANY, [&assets, layer]() {
+            assets.bodyTextures->decodeLayer(layer);
+            return true;
+        }));
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    // page files are only built on the first run or after an image changed
+    std::vector<std::string> bodyTexturePaths = SolarSystemAssets::bodyTexturePaths();
+    assets.pageFiles.resize(bodyTexturePaths.size());
+    for (int layer = 0; layer < (int)assets.pageFiles.size(); layer++)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        assetTasks.push_back(startup.add("page file " + std::to_string(layer), StartupGraph::ANY, [&assets, bodyTexturePaths, layer]() {
+            assets.pageFiles[layer] = PageFile::prepare(bodyTexturePaths[layer]);
+            return true;
+        }));
     }
-
-    GLFWimage images[1];
-    images[0].pixels = stbi_load("../../Textures/sattelite_icon.png", &images[0].width, &images[0].height, 0, 4); //rgba channels 
-    glfwSetWindowIcon(window, 1, images);
-    stbi_image_free(images[0].pixels);
-
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    //stbi_set_flip_vertically_on_load(true);
-
-    // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // build and compile shaders
-    Shader ourShader("shader.vert", "shader.frag");
-
-    // load models
-    Model planet("../../res/models/sphere.obj");
-    Model sattelite("../../res/models/Sattelite.obj");
-    Model orbit("../../res/models/orbit.obj");
-
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init(glsl_version);
-
-    ImGui::StyleColorsClassic();
-
-    for (int i = 0; i < 250; i++) {
-        stars.push_back(glm::vec3((rand() % 50 + 1) - 20, (rand() % 50 + 1) - 25, (rand() % 100 + 1) - 90));
+    assetTasks.push_back(startup.add("generate stars", StartupGraph::ANY, [&]() {
+        assets.scene.generateStars(250);
+        return true;
+    }));
+    // GL uploads, serialized on this thread once everything above is ready
+    startup.add("upload scene", StartupGraph::MAIN, [&]() {
+        system.reset(new SolarSystem(&profiler, sideDegree, std::move(assets)));
+        return true;
+    }, assetTasks);
+    startup.add("init ImGui", StartupGraph::MAIN, [&]() {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init(glsl_version);
+
+        ImGui::StyleColorsClassic();
+        imguiReady = true;
+        return true;
+    }, { createWindow });
+
+    bool started = startup.run(pool);
+    startup.report();
+    if (started)
+        renderLoop(window, *system, traceFile);
+    if (!bench.trace.empty())
+        Trace::write(bench.trace);
+
+    // every GL object goes before the context does
+    system.reset();
+    if (imguiReady)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
     }
 
-    //create cone and buffers for cone data
-    createCone(sideDegree, 2.0);
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices) * vertices.size(), &vertices.front(), GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
-
-    GLuint texture[3];
-    glGenTextures(3, texture);
-    generateTexture(texture[0], "../../res/models/Earth.jpg");
-    generateTexture(texture[1], "../../Textures/Sun.jpg");
-    generateTexture(texture[2], "../../Textures/pink.jpg");
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    glfwTerminate();
+    return started ? 0 : -1;
+}
 
-    GLint textureLocation = glGetUniformLocation(ourShader.ID, "texture");
+// runs the window until it is closed
+void renderLoop(GLFWwindow* window, SolarSystem& system, const std::string& traceFile)
+{
+    bool firstFrame = true;
+
+    // adaptive vsync by default, swapping late frames at once rather than waiting a whole refresh
+    FramePacer pacer;
+    int vsync = pacer.setVSync(FramePacer::VSYNC_ADAPTIVE);
+
+    // while paused and untouched the loop sleeps; frames that only change the UI redraw it over the
+    // cached scene image
+    RenderOnDemand onDemand(window);
+    FrameCache frameCache;
+    bool cacheFrames = true;
+    SceneState drawn = {};
+
+    // debug builds: drawing a scene whose size did not change must not touch the heap
+    FrameHeapCheck heapCheck;
+
+    // edited shaders are rebuilt in the background and swapped in at the start of a frame
+    ShaderHotReload shaderReload(window);
+    system.watchShaders(shaderReload);
+    shaderReload.start();
+
+    // assets streamed in from the UI while running; the loader goes first so its last loads still
+    // find these
+    std::vector<std::unique_ptr<Model> > streamedModels;
+    std::vector<unsigned int> streamedTextures;
+    AssetLoader loader;
+    char assetPath[256] = "../../res/models/sphere.obj";
+
+    // the scene steps on its own thread from here on, the loop only draws its newest snapshot
+    Simulation::Settings posted = simulationSettings();
+    Simulation simulation(system.scene, posted);
 
     // render loop
     while (!glfwWindowShouldClose(window))
     {
-        glm::vec4 planet1_color = glm::vec4(1.0f, 1.0f, 1.0f, transparency);
-        glm::vec4 planet2_color = glm::vec4(1.0f, 0.0f, 1.0f, transparency);
-        glm::vec4 planet3_color = glm::vec4(0.0f, 1.0f, 1.0f, transparency);
-        glm::vec4 planet4_color = glm::vec4(1.0f, 0.0f, 0.0f, transparency);
-        glm::vec4 planet5_color = glm::vec4(0.0f, 0.0f, 1.0f, transparency);
-        
+        TRACE_SCOPE("frame");
         // per-frame time logic
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        deltaTime = pacer.beginFrame();
+        profiler.beginFrame();
+        GLStats::beginFrame();
 
         // input
-        processInput(window);
+        {
+            ProfileScope zone(&profiler, "input");
+            processInput(window);
+        }
+
+        // rebuilt shaders take over before anything is drawn with the old ones
+        {
+            ProfileScope zone(&profiler, "shader reload");
+            if (shaderReload.apply() > 0)
+                frameCache.invalidate();
+        }
 
-        // render
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // finished CPU stages of streamed assets upload here, a couple of milliseconds per frame at most
+        {
+            ProfileScope zone(&profiler, "asset uploads");
+            loader.pump(2.0);
+        }
+
+        // SCENE GRAPH
+        Simulation::Settings settings = simulationSettings();
+        if (settings != posted)
+        {
+            simulation.post(settings);
+            posted = settings;
+        }
+        bool simulationCaughtUp = simulation.caughtUp();
+        Simulation::Snapshot& snapshot = simulation.latest();
+        heapCheck.begin();
 
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
         // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
 
-        // SCENE GRAPH
-        glm::mat4 model = glm::mat4(1.0f);
-        // SUN
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[1]);
-        glUniform1i(textureLocation, 0);
-        model = scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        model = glm::rotate(model, x_rotation, glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, y_rotation, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::rotate(model, z_rotation, glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::rotate(model, atime/4 * glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setInt("is_texture", 1);
-        ourShader.setVec4("ourColor", 1.0f, 1.0f, 0.0f, 1.0f);
-        ourShader.setMat4("model", model);
-        planet.Draw(ourShader);
-        ourShader.setInt("is_texture", 0);
-        
-        // orbit 1 
-        model = scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        ourShader.setVec4("ourColor", planet1_color);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-       
-        // orbit 2
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[2]);
-        glUniform1i(textureLocation, 0);
-        ourShader.setInt("is_texture", 1);
-        model = scale(model, 2.0f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", planet2_color);
-        ourShader.setMat4("model", model);  
-        orbit.Draw(ourShader);
-        
-        // orbit 3
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[0]);
-        glUniform1i(textureLocation, 0);
-        model = scale(model, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", planet3_color);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-        ourShader.setInt("is_texture", 0);
-
-        // orbit 4
-        model = scale(model, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", planet4_color);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-        models.push_back(model);
-        ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // PLANET 1
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[0]);
-        glUniform1i(textureLocation, 0);
-        model = glm::rotate(model, atime / 4 * glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));	        //orbital rotation
-        model = translate(model, glm::vec3(19.0f, 0.0f, 0.0f));									            //orbital position
-        model = scale(model, glm::vec3(1.2f, 1.2f, 1.2f));										            //size
-        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
-        model = glm::rotate(model, atime / 4 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));          //axis rotation
-        ourShader.setVec4("ourColor", 1.0f, 1.0f, 1.0f, 1.0f);									            //color
-        ourShader.setMat4("model", model);
-        planet.Draw(ourShader);
-        ourShader.setInt("is_texture", 0);
-        
-        // orbit 1
-        model = scale(model, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-
-        // orbit 2
-        model = scale(model, 1.6f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-        models.push_back(model);
-
-        //----------------------------------------------------------------------------------------------------------------
-        // MOON 1			
-        model = glm::rotate(model, atime/8 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(100.0f, 0.0f, 0.0f));
-        model = scale(model, 15.0f * glm::vec3(1.0f, 1.0f, 1.0f));
-
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, 1.0f);
-        ourShader.setMat4("model", model);
-
-        createCone(sideDegree, 2.0);
-        glBindVertexArray(VAO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices) * vertices.size(), &vertices.front(), GL_STATIC_DRAW);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-        model = models.at(models.size() - 1);
-        
-        // MOON 2			
-        model = glm::rotate(model, atime / 8 * glm::radians(100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(60.0f, 0.0f, 0.0f));
-        model = scale(model, 10.0f * glm::vec3(1.0f, 1.0f, 1.0f));
-        model = glm::rotate(model, glm::radians(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
- 
-        ourShader.setVec4("ourColor", 0.8f, 0.6f, 1.0f, 1.0f);
-        ourShader.setMat4("model", model);
-
-        createCone(sideDegree, 2.0);
-        glBindVertexArray(VAO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices)* vertices.size(), &vertices.front(), GL_STATIC_DRAW);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-        models.pop_back();
-        model = models.at(models.size() - 1);
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // PLANET 2
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[2]);
-        glUniform1i(textureLocation, 0);
-        models.push_back(model);
-        model = glm::rotate(model, atime / 4 * glm::radians(-60.0f), glm::vec3(0.0f, 1.0f, 0.0f));	        //orbital rotation
-        model = translate(model, glm::vec3(38.0f, 0.0f, 0.0f));									            //orbital position
-        model = scale(model, glm::vec3(0.9f, 0.9f, 0.9f));										            //size
-        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
-        model = glm::rotate(model, atime / 4 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));          //axis rotation
-     
-        ourShader.setInt("is_texture", 1);
-        ourShader.setVec4("ourColor", 1.0f, 0.0f, 1.0f, 1.0f);									            //color
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-        model = models.at(models.size() - 1);
-
-        /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // PLANET 3
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture[0]);
-        glUniform1i(textureLocation, 0);
-        models.push_back(model);
-        model = glm::rotate(model, atime / 4 * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));	        //orbital rotation
-        model = translate(model, glm::vec3(62.0f, 0.0f, 0.0f));									            //orbital position
-        model = scale(model, glm::vec3(2.5f, 2.5f, 2.5f));										            //size
-        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
-        model = glm::rotate(model, atime / 4 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));          //axis rotation
-        ourShader.setInt("is_texture", 1);
-        ourShader.setVec4("ourColor", 1.0f, 1.0f, 1.0f, 1.0f);									            //color
-        ourShader.setMat4("model", model);
-        planet.Draw(ourShader);
-        ourShader.setInt("is_texture", 0);
-        models.push_back(model);
-
-        // orbit 1
-        model = scale(model, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-       
-        // orbit 2
-        model = scale(model, 2.0f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-        //----------------------------------------------------------------------------------------------------------------
-        // MOON 1			
-        model = glm::rotate(model, atime / 4 * glm::radians(40.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(100.0f, 0.0f, 0.0f));
-        model = scale(model, 5.0f * glm::vec3(0.9f, 0.9f, 0.9f));
-        model = glm::rotate(model, glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
-        ourShader.setVec4("ourColor", 1.0f, 1.0f, 1.0f, 1.0);
-        ourShader.setMat4("model", model);
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-        model = models.at(models.size() - 1);
-
-        // MOON 2
-        model = glm::rotate(model, atime / 4 * glm::radians(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(3.2f, 0.0f, 0.0f));
-        model = scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        ourShader.setVec4("ourColor", 0.5, 0.5, 0.5, 1.0);
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-        models.pop_back();
-        model = models.at(models.size() - 1);
-        //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        // PLANET 4
-        models.push_back(model);
-        model = glm::rotate(model, atime / 4  *  glm::radians(25.0f), glm::vec3(0.0f, 1.0f, 0.0f));	//orbital rotation
-        model = translate(model, glm::vec3(100.0f, 0.0f, 0.0f));									        //orbital position
-        model = scale(model, glm::vec3(2.5f, 2.5f, 2.5f));										            //size
-        model = glm::rotate(model, glm::radians(-10.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            //axis tilt
-        model = glm::rotate(model, atime / 4 * glm::radians(130.0f), glm::vec3(0.0f, 1.0f, 0.0f));          //axis rotation
-        ourShader.setVec4("ourColor", 1.0f, 0.0f, 0.0f,1.0f);									            //color
-        ourShader.setMat4("model", model);
-        planet.Draw(ourShader);
-        models.push_back(model);
-
-        // orbit 1
-        model = scale(model, 0.03f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-
-        // orbit 2
-        model = scale(model, 1.5f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-
-        // orbit 3
-        model = scale(model, 1.5f * glm::vec3(1.0f, 1.0f, 1.0f));
-        ourShader.setVec4("ourColor", 0.8f, 0.8f, 1.0f, transparency);
-        ourShader.setMat4("model", model);
-        orbit.Draw(ourShader);
-        //----------------------------------------------------------------------------------------------------------------
-        // MOON 1
-        model = glm::rotate(model, atime / 4 * glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(8.2f, 0.0f, 0.0f));
-        model =  scale(model, 0.4f * glm::vec3(0.4f, 0.4f, 0.4f));
-        model = glm::rotate(model, glm::radians(2.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            
-        ourShader.setVec4("ourColor", 0.5, 0.5, 0.5, 1.0);
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-        model = models.at(models.size() - 1);
-
-        // MOON 2
-        model = glm::rotate(model, atime / 4 * glm::radians(20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(3.2f, 0.0f, 0.0f));
-        model = scale(model, 0.5f * glm::vec3(0.5f, 0.5f, 0.5f));
-        model = glm::rotate(model, glm::radians(1.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            
-        ourShader.setVec4("ourColor", 0.4, 0.4, 0.4, 1.0);
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-        model = models.at(models.size() - 1);
-
-        // MOON 3
-        model = glm::rotate(model, atime / 4 * glm::radians(60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(4.2f, 0.0f, 0.0f));
-        model = scale(model, 0.5f * glm::vec3(0.6f, 0.6f, 0.6f));
-        model = glm::rotate(model, glm::radians(-2.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            
-        ourShader.setVec4("ourColor", 0.3, 0.3, 0.3, 1.0);
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-        model = models.at(models.size() - 1);
-
-        // MOON 4
-        model = glm::rotate(model, atime / 8 * glm::radians(160.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = translate(model, glm::vec3(6.8f, 0.0f, 0.0f));
-        model = scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        model = glm::rotate(model, glm::radians(-1.0f), glm::vec3(1.0f, 0.0f, 0.0f));			            
-        ourShader.setVec4("ourColor", 0.5, 0.2, 0.5, 1.0);
-        ourShader.setMat4("model", model);
-        sattelite.Draw(ourShader);
-
-        models.pop_back();
-        model = models.at(models.size() - 1);
-
-        // stars
-        ourShader.setVec4("ourColor", 1.0, 1.0, 1.0, 1.0);
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 250; i++)
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        SceneState state = { view, projection, framebufferWidth, framebufferHeight, snapshot.step, sideDegree, wireframe_mode,
+                             system.virtualTextures.active() };
+        if (state != drawn)
+            system.virtualTextures.markChanged();
+        // pages still streaming in refine the image over the next frames
+        bool sceneChanged = !onDemand.enabled || !cacheFrames || state != drawn || system.virtualTextures.streaming();
+        if (!sceneChanged && !frameCache.restore(framebufferWidth, framebufferHeight))
+            sceneChanged = true;
+        if (sceneChanged)
         {
-            // calculate the model matrix for each object and pass it to shader before drawing
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, stars[i]);
-            
-                if ((int)(atime * 10) % 4 == 0) {
-                    model = glm::scale(model, 0.3f * glm::vec3(0.1, 0.1, 0.1));
-                }
-                else {
-                    model = glm::scale(model, 0.5f * glm::vec3(0.1, 0.1, 0.1));
-                }
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+            system.render(snapshot.bodies, view, projection, framebufferWidth, framebufferHeight, sideDegree);
+            if (onDemand.enabled && cacheFrames)
+                frameCache.store(framebufferWidth, framebufferHeight);
+            drawn = state;
         }
+        // a frame that grew a GPU buffer also grew its bookkeeping, so the GPU total is part of the shape
+        heapCheck.end({ snapshot.bodies.size(), (unsigned long long)framebufferWidth, (unsigned long long)framebufferHeight, (unsigned long long)sideDegree,
+                        GpuMemory::totalBytes(), system.renderer.usingGpuCulling(), system.hiz.enabled, cacheFrames });
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
         {
-            ImGui::Begin("View settings");
+            ProfileScope zone(&profiler, "ImGui");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            {
+                ImGui::Begin("View settings");
 
-            ImGui::SliderFloat("X Rotation", &x_rotation, -PI, PI);
-            ImGui::SliderFloat("Y Rotation", &y_rotation, -PI, PI);
-            ImGui::SliderFloat("Z Rotation", &z_rotation, -PI, PI);
+                ImGui::SliderFloat("X Rotation", &x_rotation, -PI, PI);
+                ImGui::SliderFloat("Y Rotation", &y_rotation, -PI, PI);
+                ImGui::SliderFloat("Z Rotation", &z_rotation, -PI, PI);
 
-            ImGui::SliderFloat("Speed", &speed, 0.0f, 0.1f);
-            ImGui::SliderFloat("Transparency", &transparency, 0.0f, 1.0f);
+                ImGui::SliderFloat("Speed", &speed, 0.0f, 0.1f);
+                ImGui::SliderFloat("Transparency", &transparency, 0.0f, 1.0f);
+
+                ImGui::Spacing();
+                ImGui::Spacing();
+                if (ImGui::Button("Wireframe mode"))
+                {
+                    if (wireframe_mode)
+                    {
+                        wireframe_mode = false;
+                    }
+                    else
+                    {
+                        wireframe_mode = true;
+                    }
+                }
 
-            ImGui::Spacing();
-            ImGui::Spacing();
-            if (ImGui::Button("Wireframe mode"))
-            {
                 if (wireframe_mode)
                 {
-                    wireframe_mode = false;
+                    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
                 }
                 else
                 {
-                    wireframe_mode = true;
+                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
                 }
-            }
 
-            if (wireframe_mode)
-            {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            }
-            else
-            {
-                glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-            }
+                ImGui::Spacing();
+                ImGui::Spacing();
 
-            ImGui::Spacing();
-            ImGui::Spacing();
+                ImGui::SliderInt("Degrees step", &sideDegree, 1, 60);
 
-            ImGui::SliderInt("Degrees step", &sideDegree, 1, 60);
+                ImGui::Spacing();
+                ImGui::Spacing();
 
-            ImGui::End();
-        }
+                ImGui::SliderInt("Asteroids", &asteroidCount, 0, 50000);
+                if (system.renderer.gpuCullingSupported)
+                    ImGui::Checkbox("GPU frustum culling", &system.renderer.gpuCulling);
+                else
+                    ImGui::Text("GPU frustum culling needs OpenGL 4.3");
+                ImGui::Checkbox("Occlusion culling", &system.hiz.enabled);
+                ImGui::Text("Culled bodies: %u / %u", system.hiz.culledCount, (unsigned int)snapshot.bodies.size());
+                ImGui::Text("Job threads: %u", system.jobs.threadCount());
+                ImGui::Text("Frame arena: %.1f KB, peak %.1f KB", system.arena.usedBytes() / 1024.0, system.arena.peakBytes() / 1024.0);
+                ImGui::Text("Frame ring stalls: %llu", system.renderer.streamStalls());
+                ImGui::Text("Simulation step: %.3f ms (step %llu)", simulation.stepMilliseconds(), snapshot.step);
+                ImGui::Text("Body draw calls: %u", system.renderer.drawCalls);
+
+                const char* vsyncModes[] = { "Off", "On", "Adaptive" };
+                if (ImGui::Combo("VSync", &vsync, vsyncModes, 3))
+                    vsync = pacer.setVSync((FramePacer::VSync)vsync);
+                ImGui::SliderInt("FPS cap (0 = off)", &pacer.fpsCap, 0, 240);
+                FramePacer::Stats pacing = pacer.stats();
+                ImGui::Text("Frame time: %.2f ms, jitter %.2f ms, worst %.2f ms", pacing.mean, pacing.jitter, pacing.worst);
+                ImGui::Checkbox("Render on demand", &onDemand.enabled);
+                ImGui::SameLine();
+                ImGui::Checkbox("Cache last frame", &cacheFrames);
+                ImGui::Text("Idle waits: %llu", onDemand.idleWaits);
+                ImGui::Text("Shader reloads: %u (%u failed)", shaderReload.reloads, shaderReload.failures);
+                ImGui::Text("Program cache: %u loaded, %u missed", ProgramCache::hits(), ProgramCache::misses());
+                if (system.virtualTextures.supported)
+                {
+                    ImGui::Checkbox("Virtual texturing", &system.virtualTextures.enabled);
+                    ImGui::Text("Pages: %d of %d resident, %d loading, %llu uploads, %llu evictions", system.virtualTextures.residentPages(),
+                                system.virtualTextures.slotCount(), system.virtualTextures.loadingPages(), system.virtualTextures.uploads,
+                                system.virtualTextures.evictions);
+                }
+                if (!shaderReload.lastLog.empty())
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", shaderReload.lastLog.c_str());
+
+                if (ImGui::CollapsingHeader("GL counters (last frame)"))
+                {
+                    const GLFrameCounters& counters = GLStats::lastFrame();
+                    ImGui::Text("Draws: %u (+%u indirect), dispatches: %u", counters.draws, counters.indirectDraws, counters.dispatches);
+                    ImGui::Text("Triangles: %llu", counters.triangles);
+                    ImGui::Text("Binds: %u programs, %u VAOs, %u textures, %u buffers", counters.programBinds, counters.vaoBinds, counters.textureBinds, counters.bufferBinds);
+                    ImGui::Text("Uniform calls: %u", counters.uniformCalls);
+                    ImGui::Text("Uploads: %u, %.1f KB", counters.uploads, counters.uploadBytes / 1024.0);
+                }
 
-        atime += speed/2;
+                // Chrome trace-event timeline, open it in chrome://tracing or ui.perfetto.dev
+                bool tracing = Trace::enabled();
+                if (ImGui::Checkbox("Record trace", &tracing))
+                    Trace::setEnabled(tracing);
+                ImGui::SameLine();
+                if (ImGui::Button("Write trace"))
+                    Trace::write(traceFile);
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                ImGui::InputText("Asset path", assetPath, sizeof(assetPath));
+                if (ImGui::Button("Stream model"))
+                {
+                    loader.spawn(loadModel(loader, assetPath), [&](std::unique_ptr<Model> model) {
+                        streamedModels.push_back(std::move(model));
+                    });
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Stream texture"))
+                {
+                    loader.spawn(loadTexture(loader, assetPath), [&](unsigned int texture) {
+                        if (texture != 0)
+                            streamedTextures.push_back(texture);
+                    });
+                }
+                ImGui::Text("Streamed %u models, %u textures, %d loading", (unsigned int)streamedModels.size(),
+                            (unsigned int)streamedTextures.size(), loader.pending());
+
+                ImGui::End();
+            }
+            profiler.drawOverlay();
+            GpuMemory::drawTable(system.arena);
+
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        profiler.endFrame();
+        pacer.waitForDeadline();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            TRACE_SCOPE("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        // the frame's transient data is gone from here on
+        system.arena.reset();
+        if (firstFrame)
+        {
+            // time-to-first-frame, from the start of the process
+            LOG_INFO("STARTUP::FIRST_FRAME {:.2f} ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count());
+            firstFrame = false;
+        }
+        {
+            // idle: paused with every change applied, the scene already on screen, nothing loading and
+            // no text being typed
+            bool idle = !sceneChanged && posted.speed == 0.0f && simulationCaughtUp && loader.pending() == 0 && !ImGui::GetIO().WantTextInput;
+            TRACE_SCOPE("poll events");
+            onDemand.waitEvents(idle);
+        }
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    glfwTerminate();
-    return 0;
+    // streamed textures are not owned by anything else
+    loader.finish();
+    if (!streamedTextures.empty())
+        GpuMemory::deleteTextures((int)streamedTextures.size(), &streamedTextures[0]);
+}
+
+// the UI's current simulation settings
+Simulation::Settings simulationSettings()
+{
+    Simulation::Settings settings = { speed, x_rotation, y_rotation, z_rotation, transparency, asteroidCount };
+    return settings;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -522,13 +554,13 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        camera.ProcessKeyboard(FORWARD, (float)deltaTime);
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        camera.ProcessKeyboard(BACKWARD, (float)deltaTime);
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        camera.ProcessKeyboard(LEFT, (float)deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        camera.ProcessKeyboard(RIGHT, (float)deltaTime);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -544,35 +576,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
-
-void createCone(int details, float height)
-{
-    vertices.clear();
-
-    //sides
-    for (int k = 0; k <= 360; k += details)
-    {
-        vertices.push_back(glm::vec3(0.0, 0.0, height));
-        vertices.push_back(glm::vec3(Cos(k), Sin(k), 0.0));
-        vertices.push_back(glm::vec3(Cos(k + details), Sin(k + details), 0.0));
-    }
-
-    //base
-   
-    for (int k = 0; k <= 360; k += details)
-    {
-        vertices.push_back(glm::vec3(0.0f, 0.0f, 0.0f));
-        vertices.push_back(glm::vec3(Cos(k), Sin(k), 0.0f));
-        vertices.push_back(glm::vec3(Cos(k + details), Sin(k + details), 0.0f));
-    }
-}
-void generateTexture(GLuint texture, const char* filename) {
-    int w, h, n;
-    glBindTexture(GL_TEXTURE_2D, texture);
-    unsigned char* data = stbi_load(filename, &w, &h, &n, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    stbi_image_free(data);
-
-}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+// virtual texture feedback: the page and mip every pixel of a textured body needs, see VirtualTexture
+layout (location = 0) out uint feedback;
+
+in vec2 TexCoord;
+in vec4 color;
+flat in float layer;
+
+// pages of mip 0 and mip count of each layer, must match VirtualTexture::MAX_LAYERS
+uniform vec2 layerPages[8];
+uniform int layerMips[8];
+uniform float pageSize;
+// this pass runs at a fraction of the frame resolution, the bias brings the mip back to the frame's
+uniform float mipBias;
+
+void main()
+{
+	if(layer < 0.0)
+		discard;
+	int l = int(layer + 0.5);
+	vec2 texels = TexCoord * layerPages[l] * pageSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	int mip = clamp(int(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + mipBias), 0, layerMips[l] - 1);
+
+	vec2 uv = clamp(TexCoord, 0.0, 0.99999);
+	uvec2 page = uvec2(uv * max(layerPages[l] / float(1 << mip), vec2(1.0)));
+	feedback = (uint(l) << 28) | (uint(mip) << 24) | (page.y << 12) | page.x;
+}